@@ -0,0 +1,138 @@
+#include "MappedShape.hpp"
+#include "ShapeFormat.hpp"
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const std::size_t V1_HEADER_SIZE = ShapeFormat::MAGIC_V1.size() + 2 * sizeof(uint64_t);
+
+MappedShape::MappedShape() noexcept{
+    mapping = nullptr;
+    mapping_size = 0;
+    shape = Shape::View{nullptr, 0, 0, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+}
+
+MappedShape::MappedShape(const char *file, bool verify):MappedShape(){
+    int fd = open(file, O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error(strerror(errno));
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        int err = errno;
+        close(fd);
+        throw std::runtime_error(strerror(err));
+    }
+
+    if((std::size_t)st.st_size < V1_HEADER_SIZE){
+        close(fd);
+        throw std::invalid_argument("shape is truncated");
+    }
+
+    mapping_size = st.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+
+    if(mapping == MAP_FAILED){
+        mapping = nullptr;
+        mapping_size = 0;
+        throw std::runtime_error(strerror(err));
+    }
+
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    try{
+        map_view(verify);
+    }
+    catch(std::exception &){
+        unmap();
+        throw;
+    }
+}
+
+void MappedShape::map_view(bool verify){
+    const uint8_t *bytes = static_cast<const uint8_t*>(mapping);
+
+    if(memcmp(bytes, ShapeFormat::MAGIC_V1.data(), ShapeFormat::MAGIC_V1.size()) == 0){
+        uint64_t width, height;
+        memcpy(&width, bytes + ShapeFormat::MAGIC_V1.size(), sizeof(width));
+        memcpy(&height, bytes + ShapeFormat::MAGIC_V1.size() + sizeof(width), sizeof(height));
+
+        if(height && width > (mapping_size - V1_HEADER_SIZE) / sizeof(float) / height){
+            throw std::invalid_argument("shape is truncated");
+        }
+
+        shape = Shape::View{bytes + V1_HEADER_SIZE, width, height, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+        return;
+    }
+
+    if(mapping_size < ShapeFormat::HEADER_SIZE){
+        throw std::invalid_argument("shape is truncated");
+    }
+
+    ShapeFormat::Header header = ShapeFormat::decode(bytes);
+
+    if(header.flags & ShapeFormat::FLAG_COMPRESSED){
+        throw std::invalid_argument("compressed shapes cannot be mapped");
+    }
+
+    if(header.payload_offset > mapping_size || header.payload_size > mapping_size - header.payload_offset){
+        throw std::invalid_argument("shape is truncated");
+    }
+
+    if(!ShapeFormat::host_is_little_endian()){
+        throw std::runtime_error("mapping shapes needs a little endian host");
+    }
+
+    if(verify && ShapeFormat::crc32c(0, bytes + header.payload_offset, header.payload_size) != header.payload_crc){
+        throw std::invalid_argument("shape checksum mismatch");
+    }
+
+    shape = Shape::View{bytes + header.payload_offset, header.width, header.height, header.format, header.range};
+}
+
+MappedShape::MappedShape(MappedShape &&other) noexcept:MappedShape(){
+    *this = std::move(other);
+}
+
+MappedShape &MappedShape::operator=(MappedShape &&other) noexcept{
+    if(this != &other){
+        unmap();
+        mapping = other.mapping;
+        mapping_size = other.mapping_size;
+        shape = other.shape;
+
+        other.mapping = nullptr;
+        other.mapping_size = 0;
+        other.shape = Shape::View{nullptr, 0, 0, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+    }
+    return *this;
+}
+
+MappedShape::~MappedShape() noexcept{
+    unmap();
+}
+
+Shape::View MappedShape::view() const noexcept{
+    return shape;
+}
+
+bool MappedShape::is_mapped() const noexcept{
+    return mapping != nullptr;
+}
+
+void MappedShape::unmap() noexcept{
+    if(mapping){
+        munmap(mapping, mapping_size);
+    }
+
+    mapping = nullptr;
+    mapping_size = 0;
+    shape = Shape::View{nullptr, 0, 0, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+}
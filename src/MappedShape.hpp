@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Shape.hpp"
+
+//.shape file mapped into memory, its fragments are read in place without copying
+class MappedShape final{
+public:
+    MappedShape() noexcept;
+
+    //maps v1 and v2 files of any format, verify checks the v2 payload checksum (reads the whole payload)
+    //runtime_error if cannot map the file
+    //invalid_argument if it is not a shape file
+    MappedShape(const char *file, bool verify = true);
+    MappedShape(MappedShape &&other) noexcept;
+    MappedShape &operator=(MappedShape &&other) noexcept;
+    ~MappedShape() noexcept;
+
+    //invalidated by unmap
+    Shape::View view() const noexcept;
+    bool is_mapped() const noexcept;
+
+    void unmap() noexcept;
+private:
+    void map_view(bool verify);
+
+    void *mapping;
+    std::size_t mapping_size;
+    Shape::View shape;
+
+    MappedShape(const MappedShape &copy) noexcept = delete;
+    MappedShape &operator=(const MappedShape &copy) noexcept = delete;
+};
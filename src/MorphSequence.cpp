@@ -0,0 +1,86 @@
+#include "MorphSequence.hpp"
+#include <math.h>
+#include <stdexcept>
+
+float MorphSequence::smoothstep(float progress) noexcept{
+    return progress * progress * (3.0f - 2.0f * progress);
+}
+
+float MorphSequence::smootherstep(float progress) noexcept{
+    return progress * progress * progress * (progress * (progress * 6.0f - 15.0f) + 10.0f);
+}
+
+MorphSequence::MorphSequence(const Shape::Renderer &renderer, const std::vector<Shape::View> &keyframes, Easing easing){
+    glGenTextures(1, &_texture);
+
+    try{
+        renderer.shape_texture_array(keyframes, _texture);
+    }
+    catch(std::exception &){
+        glDeleteTextures(1, &_texture);
+        throw;
+    }
+
+    this->keyframes = keyframes.size();
+    this->easing = easing;
+}
+
+MorphSequence::~MorphSequence() noexcept{
+    glDeleteTextures(1, &_texture);
+}
+
+void MorphSequence::segment(float position, GLint &layer1, GLint &layer2, float &progress) const noexcept{
+    float last = keyframes - 1;
+    //written so nan ends up at 0
+    position = position > 0.0f ? position : 0.0f;
+    position = position < last ? position : last;
+
+    float first = floorf(position);
+    if(first >= last){
+        layer1 = layer2 = keyframes - 1;
+        progress = 0.0f;
+        return;
+    }
+
+    layer1 = first;
+    layer2 = layer1 + 1;
+    progress = position - first;
+    if(easing){
+        progress = easing(progress);
+    }
+}
+
+void MorphSequence::submit(Shape::Renderer &renderer, float position, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const{
+    GLint layer1, layer2;
+    float progress;
+    segment(position, layer1, layer2, progress);
+
+    if(progress == 0.0f){
+        renderer.submit(layer1, color, power, mvp, tex_mvp);
+    }
+    else{
+        renderer.submit_morph(layer1, layer2, color, power, progress, mvp, tex_mvp);
+    }
+}
+
+void MorphSequence::render(Shape::Renderer &renderer, float position, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const{
+    renderer.begin(_texture);
+    submit(renderer, position, color, power, mvp, tex_mvp);
+    renderer.flush();
+}
+
+GLuint MorphSequence::texture() const noexcept{
+    return _texture;
+}
+
+std::size_t MorphSequence::get_keyframes() const noexcept{
+    return keyframes;
+}
+
+MorphSequence::Easing MorphSequence::get_easing() const noexcept{
+    return easing;
+}
+
+void MorphSequence::set_easing(Easing easing) noexcept{
+    this->easing = easing;
+}
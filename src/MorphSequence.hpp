@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Shape.hpp"
+
+//keyframe shapes stored as the layers of one texture array, rendered at any position of the timeline
+//with the batch path of Shape::Renderer, so a frame of the animation is one bind and one draw
+class MorphSequence final{
+public:
+    //maps the progress within a segment, [0, 1] to [0, 1]
+    typedef float (*Easing)(float progress);
+
+    static float smoothstep(float progress) noexcept;
+    static float smootherstep(float progress) noexcept;
+
+    //uploads the keyframes (same size and format), easing nullptr is linear
+    //invalid_argument if there are no keyframes or they differ in size or format
+    MorphSequence(const Shape::Renderer &renderer, const std::vector<Shape::View> &keyframes, Easing easing = nullptr);
+    ~MorphSequence() noexcept;
+
+    //position is in keyframes: 2.25 is a quarter of the way from keyframe 2 to 3, clamped to [0, keyframes - 1]
+    void segment(float position, GLint &layer1, GLint &layer2, float &progress) const noexcept;
+
+    //adds the sequence at position to the batch, which must be begun on texture()
+    void submit(Shape::Renderer &renderer, float position, const glm::vec4 &color, float power, const glm::mat4 &mvp = Shape::Renderer::IDENTITY, const glm::mat4 &tex_mvp = Shape::Renderer::IDENTITY) const;
+    //draws the sequence at position on its own, not to be called while another batch is being submitted
+    void render(Shape::Renderer &renderer, float position, const glm::vec4 &color, float power, const glm::mat4 &mvp = Shape::Renderer::IDENTITY, const glm::mat4 &tex_mvp = Shape::Renderer::IDENTITY) const;
+
+    GLuint texture() const noexcept;
+    std::size_t get_keyframes() const noexcept;
+    Easing get_easing() const noexcept;
+    void set_easing(Easing easing) noexcept;
+private:
+    GLuint _texture;
+    std::size_t keyframes;
+    Easing easing;
+
+    MorphSequence(const MorphSequence &copy) noexcept = delete;
+    MorphSequence &operator=(const MorphSequence &copy) noexcept = delete;
+};
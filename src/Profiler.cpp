@@ -0,0 +1,201 @@
+#include "Profiler.hpp"
+#include <mutex>
+#include <cstdio>
+
+namespace Profiler{
+
+namespace{
+
+struct State{
+    std::atomic<bool> enabled;
+    std::atomic<std::uint64_t> gpu_dropped;
+    std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> counters;
+
+    //timers, frame and total counters
+    std::mutex mutex;
+    std::array<TimerStats, CPU_TIMER_COUNT> cpu;
+    std::array<TimerStats, GPU_TIMER_COUNT> gpu;
+    std::array<std::uint64_t, COUNTER_COUNT> frame;
+    std::array<std::uint64_t, COUNTER_COUNT> closed;
+    std::uint64_t frames;
+};
+
+State &state() noexcept{
+    static State s{};
+    return s;
+}
+
+void add(TimerStats &stats, double ms) noexcept{
+    stats.calls++;
+    stats.total_ms += ms;
+    stats.max_ms = ms > stats.max_ms ? ms : stats.max_ms;
+}
+
+void timers_json(std::string &json, const char *key, const TimerStats *timers, std::size_t count, const char *(*timer_name)(std::size_t)){
+    json += "  \"";
+    json += key;
+    json += "\": {";
+
+    char line[160];
+    for(std::size_t i = 0; i < count; i++){
+        snprintf(line, sizeof(line), "%s\n    \"%s\": {\"calls\": %llu, \"total_ms\": %.6f, \"max_ms\": %.6f}",
+            i ? "," : "", timer_name(i), (unsigned long long)timers[i].calls, timers[i].total_ms, timers[i].max_ms);
+        json += line;
+    }
+    json += "\n  },\n";
+}
+
+void counters_json(std::string &json, const char *key, const std::array<std::uint64_t, COUNTER_COUNT> &counters){
+    json += "  \"";
+    json += key;
+    json += "\": {";
+
+    char line[96];
+    for(std::size_t i = 0; i < COUNTER_COUNT; i++){
+        snprintf(line, sizeof(line), "%s\"%s\": %llu", i ? ", " : "", name((Counter)i), (unsigned long long)counters[i]);
+        json += line;
+    }
+    json += "},\n";
+}
+
+}
+
+void set_enabled(bool enabled) noexcept{
+    state().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool is_enabled() noexcept{
+    return state().enabled.load(std::memory_order_relaxed);
+}
+
+void reset() noexcept{
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    s.gpu_dropped = 0;
+    for(auto &counter:s.counters){
+        counter = 0;
+    }
+    s.cpu = {};
+    s.gpu = {};
+    s.frame = {};
+    s.closed = {};
+    s.frames = 0;
+}
+
+void next_frame() noexcept{
+    if(!is_enabled()) return;
+
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    for(std::size_t i = 0; i < COUNTER_COUNT; i++){
+        s.frame[i] = s.counters[i].exchange(0, std::memory_order_relaxed);
+        s.closed[i] += s.frame[i];
+    }
+    s.frames++;
+}
+
+Stats stats() noexcept{
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    Stats result;
+    result.cpu = s.cpu;
+    result.gpu = s.gpu;
+    result.gpu_dropped = s.gpu_dropped.load(std::memory_order_relaxed);
+    result.frame = s.frame;
+    for(std::size_t i = 0; i < COUNTER_COUNT; i++){
+        result.total[i] = s.closed[i] + s.counters[i].load(std::memory_order_relaxed);
+    }
+    result.frames = s.frames;
+    return result;
+}
+
+std::string to_json(const Stats &stats){
+    std::string json = "{\n";
+    timers_json(json, "cpu", stats.cpu.data(), stats.cpu.size(), [](std::size_t i){ return name((CpuTimer)i); });
+    timers_json(json, "gpu", stats.gpu.data(), stats.gpu.size(), [](std::size_t i){ return name((GpuTimer)i); });
+    counters_json(json, "frame", stats.frame);
+    counters_json(json, "total", stats.total);
+
+    char line[96];
+    snprintf(line, sizeof(line), "  \"gpu_dropped\": %llu,\n  \"frames\": %llu\n}\n",
+        (unsigned long long)stats.gpu_dropped, (unsigned long long)stats.frames);
+    json += line;
+    return json;
+}
+
+const char *name(CpuTimer timer) noexcept{
+    switch (timer){
+    case CPU_DRAW_CIRCLE: return "draw_circle";
+    case CPU_DRAW_CIRCLES: return "draw_circles";
+    case CPU_CSG: return "csg";
+    case CPU_FILL: return "fill";
+    case CPU_STREAM_READ: return "stream_read";
+    case CPU_STREAM_WRITE: return "stream_write";
+    case CPU_SHAPE_TEXTURE: return "shape_texture";
+    case CPU_SHADER_COMPILE: return "shader_compile";
+    case CPU_PROGRAM_LINK: return "program_link";
+    case CPU_PROGRAM_LOAD: return "program_load";
+    default: return "unknown";
+    }
+}
+
+const char *name(GpuTimer timer) noexcept{
+    switch (timer){
+    case GPU_RENDER: return "render";
+    case GPU_BATCH: return "batch";
+    case GPU_BAKE: return "bake";
+    default: return "unknown";
+    }
+}
+
+const char *name(Counter counter) noexcept{
+    switch (counter){
+    case COUNTER_DRAWS: return "draws";
+    case COUNTER_BINDS: return "binds";
+    case COUNTER_UNIFORMS: return "uniforms";
+    case COUNTER_UPLOAD_BYTES: return "upload_bytes";
+    default: return "unknown";
+    }
+}
+
+void count(Counter counter, std::uint64_t amount) noexcept{
+    if(!is_enabled()) return;
+    state().counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void record(CpuTimer timer, double ms) noexcept{
+    if(!is_enabled()) return;
+
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    add(s.cpu[timer], ms);
+}
+
+void record(GpuTimer timer, double ms) noexcept{
+    if(!is_enabled()) return;
+
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    add(s.gpu[timer], ms);
+}
+
+void drop_gpu_timing() noexcept{
+    if(!is_enabled()) return;
+    state().gpu_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScopedTimer::ScopedTimer(CpuTimer timer) noexcept{
+    this->timer = timer;
+    active = is_enabled();
+    if(active) begin = std::chrono::steady_clock::now();
+}
+
+ScopedTimer::~ScopedTimer() noexcept{
+    if(!active) return;
+    record(timer, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+}
+
+}
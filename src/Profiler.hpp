@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//opt-in, process wide instrumentation of the library hot paths:
+//cpu timers, gpu timers (GL_TIME_ELAPSED queries of Shape::Renderer) and per frame counters
+//off by default, then every hook costs one relaxed atomic load
+//thread safe, except that gpu timers and counters of a renderer belong to its gl thread
+namespace Profiler{
+    enum CpuTimer{
+        CPU_DRAW_CIRCLE,
+        CPU_DRAW_CIRCLES,
+        //Shape unite, intersect, subtract and offset
+        CPU_CSG,
+        //Shape::fill, which ShapeExpr::bake evaluates expressions in
+        CPU_FILL,
+        //Shape constructors reading streams, files and memory
+        CPU_STREAM_READ,
+        CPU_STREAM_WRITE,
+        CPU_SHAPE_TEXTURE,
+        CPU_SHADER_COMPILE,
+        CPU_PROGRAM_LINK,
+        //GlUtil::Program::build reading a cached program binary
+        CPU_PROGRAM_LOAD,
+        CPU_TIMER_COUNT,
+    };
+
+    enum GpuTimer{
+        //render, render_morph and their tight and pair variants
+        GPU_RENDER,
+        //Renderer::flush
+        GPU_BATCH,
+        GPU_BAKE,
+        GPU_TIMER_COUNT,
+    };
+
+    enum Counter{
+        COUNTER_DRAWS,
+        //programs, vertex arrays and textures bound by Shape::Renderer
+        COUNTER_BINDS,
+        COUNTER_UNIFORMS,
+        //texture and buffer data uploaded by Shape::Renderer
+        COUNTER_UPLOAD_BYTES,
+        COUNTER_COUNT,
+    };
+
+    struct TimerStats{
+        std::uint64_t calls;
+        double total_ms;
+        double max_ms;
+    };
+
+    struct Stats{
+        std::array<TimerStats, CPU_TIMER_COUNT> cpu;
+        //gpu times arrive a few frames late, when Shape::Renderer finds their queries finished
+        std::array<TimerStats, GPU_TIMER_COUNT> gpu;
+        //gpu timings skipped because the query ring was full or another GL_TIME_ELAPSED query was active
+        std::uint64_t gpu_dropped;
+        //counters of the last frame closed by next_frame, and since reset
+        std::array<std::uint64_t, COUNTER_COUNT> frame;
+        std::array<std::uint64_t, COUNTER_COUNT> total;
+        std::uint64_t frames;
+    };
+
+    void set_enabled(bool enabled) noexcept;
+    bool is_enabled() noexcept;
+    //zeroes everything
+    void reset() noexcept;
+    //closes the counters of a frame, Shape::Renderer::end_frame calls it
+    void next_frame() noexcept;
+
+    Stats stats() noexcept;
+    std::string to_json(const Stats &stats);
+
+    const char *name(CpuTimer timer) noexcept;
+    const char *name(GpuTimer timer) noexcept;
+    const char *name(Counter counter) noexcept;
+
+    //hooks, no-ops while disabled
+    void count(Counter counter, std::uint64_t amount = 1) noexcept;
+    void record(CpuTimer timer, double ms) noexcept;
+    void record(GpuTimer timer, double ms) noexcept;
+    void drop_gpu_timing() noexcept;
+
+    //records the time until destruction, if enabled at construction
+    class ScopedTimer final{
+    public:
+        explicit ScopedTimer(CpuTimer timer) noexcept;
+        ~ScopedTimer() noexcept;
+    private:
+        CpuTimer timer;
+        bool active;
+        std::chrono::steady_clock::time_point begin;
+
+        ScopedTimer(const ScopedTimer &copy) noexcept = delete;
+        ScopedTimer &operator=(const ScopedTimer &copy) noexcept = delete;
+    };
+}
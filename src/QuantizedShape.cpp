@@ -0,0 +1,134 @@
+#include "QuantizedShape.hpp"
+#include "ShapeKernel.hpp"
+#include "ShapeCodec.hpp"
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+
+QuantizedShape::QuantizedShape(const Shape::View &shape, ShapeFormat::Format format, float range){
+    ShapeFormat::Header header = ShapeFormat::header_for(shape.width, shape.height, format, range);
+
+    this->width = shape.width;
+    this->height = shape.height;
+    this->format = format;
+    this->range = ShapeFormat::is_normalized(format) ? range : 1.0f;
+    this->fragments.resize(header.payload_size);
+
+    if(shape.format == ShapeFormat::FORMAT_FLOAT32){
+        ShapeKernel::quantize(static_cast<const float*>(shape.fragments), fragments.data(), width * height, format, this->range);
+    }
+    else{
+        std::vector<float> dequantized(width * height);
+        ShapeKernel::dequantize(shape.fragments, dequantized.data(), dequantized.size(), shape.format, shape.range);
+        ShapeKernel::quantize(dequantized.data(), fragments.data(), dequantized.size(), format, this->range);
+    }
+}
+
+QuantizedShape::QuantizedShape(const Shape &shape, ShapeFormat::Format format, float range)
+:QuantizedShape(shape.view(), format, range){}
+
+QuantizedShape::QuantizedShape(FILE *stream, bool magic){
+    if(magic){
+        init_from_stream(stream);
+    }
+    else{
+        init_from_stream_without_magic(stream);
+    }
+}
+
+QuantizedShape::QuantizedShape(const char *file){
+    FILE *f = fopen(file, "rb");
+
+    if(f){
+        try{
+            init_from_stream(f);
+        }
+        catch (std::exception &){
+            fclose(f);
+            throw;
+        }
+        fclose(f);
+    }
+    else{
+        throw std::runtime_error(strerror(errno));
+    }
+}
+
+void QuantizedShape::write_to_stream(FILE *stream, bool write_magic, bool compress) const{
+    ShapeFormat::Header header = ShapeFormat::header_for(width, height, format, range);
+
+    if(compress){
+        ShapeCodec::write(stream, header, fragments.data(), write_magic);
+    }
+    else{
+        ShapeFormat::write(stream, header, fragments.data(), write_magic);
+    }
+}
+
+void QuantizedShape::write_to_file(const char *file, bool compress) const{
+    FILE *f = fopen(file, "wb");
+    if(!f){
+        throw std::runtime_error(strerror(errno));
+    }
+
+    try{
+        write_to_stream(f, true, compress);
+        fclose(f);
+    }
+    catch(std::exception &){
+        fclose(f);
+        throw;
+    }
+}
+
+std::size_t QuantizedShape::get_width() const noexcept{
+    return width;
+}
+
+std::size_t QuantizedShape::get_height() const noexcept{
+    return height;
+}
+
+ShapeFormat::Format QuantizedShape::get_format() const noexcept{
+    return format;
+}
+
+float QuantizedShape::get_range() const noexcept{
+    return range;
+}
+
+Shape::View QuantizedShape::view() const noexcept{
+    return Shape::View{fragments.data(), width, height, format, range};
+}
+
+void QuantizedShape::init_from_stream(FILE *stream){
+    std::array<char, 8> magic{};
+    if(fread(&magic[0], 1, magic.size(), stream) != magic.size()){
+        ShapeFormat::throw_read_error(stream);
+    }
+
+    if(magic != ShapeFormat::MAGIC){
+        throw std::invalid_argument("shape magic mismatch");
+    }
+
+    init_from_stream_without_magic(stream);
+}
+
+void QuantizedShape::init_from_stream_without_magic(FILE *stream){
+    ShapeFormat::Header header = ShapeFormat::read_header_without_magic(stream);
+
+    width = header.width;
+    height = header.height;
+    format = header.format;
+    range = ShapeFormat::is_normalized(format) ? header.range : 1.0f;
+
+    fragments.resize(width * height * ShapeFormat::fragment_size(format));
+
+    if(header.flags & ShapeFormat::FLAG_COMPRESSED){
+        ShapeCodec::Decoder decoder(stream, header);
+        while(decoder.next(fragments.data() + decoder.get_row() * decoder.row_size()));
+    }
+    else{
+        ShapeFormat::read_payload(stream, header, fragments.data());
+    }
+}
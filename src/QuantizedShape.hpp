@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Shape.hpp"
+
+//shape fragments stored in a compact format (see ShapeFormat::Format), for keeping and uploading baked shapes
+class QuantizedShape final{
+public:
+    //range is the distance normalized formats store as +-1, fragments beyond it are clamped
+    //invalid_argument if the range is not positive and finite for a normalized format
+    QuantizedShape(const Shape::View &shape, ShapeFormat::Format format, float range = 1.0f);
+    QuantizedShape(const Shape &shape, ShapeFormat::Format format, float range = 1.0f);
+
+    //reads v2 shapes of any format without converting them
+    QuantizedShape(FILE *stream, bool magic = true);
+    QuantizedShape(const char *file);
+
+    void write_to_stream(FILE *stream, bool write_magic = true, bool compress = false) const;
+    void write_to_file(const char *file, bool compress = false) const;
+
+    std::size_t get_width() const noexcept;
+    std::size_t get_height() const noexcept;
+    ShapeFormat::Format get_format() const noexcept;
+    float get_range() const noexcept;
+
+    //invalidated when the shape is destroyed or assigned
+    Shape::View view() const noexcept;
+private:
+    void init_from_stream(FILE *stream);
+    void init_from_stream_without_magic(FILE *stream);
+
+    std::vector<uint8_t> fragments;
+    std::size_t width;
+    std::size_t height;
+    ShapeFormat::Format format;
+    float range;
+};
@@ -1,24 +1,107 @@
 #include "Shape.hpp"
 #include <math.h>
 #include <array>
+#include <cstddef>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <string.h>
 #include <errno.h>
 #include <glm/glm.hpp>
+#include "ShapeKernel.hpp"
+#include "Profiler.hpp"
+#include "ShapeFormat.hpp"
+#include "ShapeCodec.hpp"
+#include "ThreadPool.hpp"
+#include "ShapePyramid.hpp"
+
+//distance from the circle center below which it can raise fragments >= floor,
+//padded so float rounding never culls a fragment the exact test would change
+static float circle_reach(float cr, float floor) noexcept{
+    return cr - floor + 1e-4f * (1.0f + fabsf(cr) + fabsf(floor));
+}
+
+//fragment indices [begin, end) whose gl space coordinate can lie in [center - radius, center + radius]
+static void fragment_range(double center, double radius, std::size_t size, std::size_t &begin, std::size_t &end) noexcept{
+    double half_size = 0.5 * size;
+    double lo = floor((center - radius + 1.0) * half_size) - 1.0;
+    double hi = ceil((center + radius + 1.0) * half_size) + 2.0;
+    begin = (std::size_t)std::clamp(lo, 0.0, (double)size);
+    end = (std::size_t)std::clamp(hi, 0.0, (double)size);
+}
+
+//vertex and fragment shader of render, render_morph and render_morph_pair, specialized by Renderer::VariantFlag defines
+static const char *RENDER_VERTEX_SHADER = R"GLSL(
+    #version 110
 
-static const std::array<char, 8> SHAPE_MAGIC{'S', 'H', 'A', 'P', 'E', ' ', '\n', '\0'};
+    attribute vec4 v_pos;
+    uniform mat4 v_mvp;
+    uniform mat4 v_tex_mvp;
+
+    varying vec2 f_uvpos;
+
+    void main(){
+        vec4 pos = v_pos * v_mvp;
+        f_uvpos = (vec4(v_pos.xy, 1, 1) * v_tex_mvp).xy  * vec2(0.5) + vec2(0.5);
+        gl_Position = pos;
+    }
+)GLSL";
+
+static const char *RENDER_FRAGMENT_SHADER = R"GLSL(
+    #version 110
+
+    uniform vec4 f_color;
+    uniform float f_power;
+    uniform float f_progress;
+    uniform sampler2D f_shape1;
+    uniform sampler2D f_shape2;
+
+    varying vec2 f_uvpos;
+
+    void main(){
+    #if defined(PACKED_MORPH)
+        vec2 pair = texture2D(f_shape1, f_uvpos).rg;
+        float shape = mix(pair.r, pair.g, f_progress);
+    #elif defined(MORPH)
+        float shape = mix(texture2D(f_shape1, f_uvpos).r, texture2D(f_shape2, f_uvpos).r, f_progress);
+    #else
+        float shape = texture2D(f_shape1, f_uvpos).r;
+    #endif
+
+    #if defined(PIXELATED)
+        float mask = shape > 0.0 ? 1.0 : -1.0;
+    #else
+        float mask = clamp(shape * f_power, -1.0, 1.0);
+    #endif
+
+    #if !defined(NO_ALPHA)
+        mask *= f_color.a;
+    #endif
+
+    #if defined(PREMULTIPLIED)
+        mask = max(mask, 0.0);
+        gl_FragColor = vec4(f_color.rgb * mask, mask);
+    #else
+        gl_FragColor = vec4(f_color.rgb, mask);
+    #endif
+    }
+)GLSL";
 
 Shape::Shape(std::size_t width, std::size_t height) noexcept{
+    this->pool = nullptr;
     this->width = width;
     this->height = height;
     this->fragments.resize(width * height);
     for(auto &frag:fragments){
         frag = -INFINITY;
     }
+    this->floors.assign(tiles_x() * tiles_y(), -INFINITY);
+    this->dirty.assign(tiles_x() * tiles_y(), 0);
 }
 
 Shape::Shape(FILE *stream, bool magic){
+    Profiler::ScopedTimer timer(Profiler::CPU_STREAM_READ);
+    pool = nullptr;
     if(magic){
         init_from_stream(stream); 
     }
@@ -28,6 +111,8 @@ Shape::Shape(FILE *stream, bool magic){
 }
 
 Shape::Shape(const char *file){
+    Profiler::ScopedTimer timer(Profiler::CPU_STREAM_READ);
+    pool = nullptr;
     FILE *f = fopen(file, "rb");
 
     if(f){
@@ -45,7 +130,18 @@ Shape::Shape(const char *file){
     }
 }
 
+Shape::Shape(const View &view){
+    pool = nullptr;
+    width = view.width;
+    height = view.height;
+    fragments.resize(width * height);
+    ShapeKernel::dequantize(view.fragments, fragments.data(), fragments.size(), view.format, view.range);
+    init_floors();
+}
+
 Shape::Shape(std::vector<uint8_t> data, bool magic){
+    Profiler::ScopedTimer timer(Profiler::CPU_STREAM_READ);
+    pool = nullptr;
     FILE *f = fmemopen(data.data(), data.size(), "rb");
 
     if(f){
@@ -68,25 +164,26 @@ Shape::Shape(std::vector<uint8_t> data, bool magic){
     }
 }
 
-void Shape::write_to_stream(FILE *stream, bool write_magic) const{
-    if(write_magic){
-        fwrite("SHAPE \n\0", 1, 8, stream);
-    }
-    fwrite(&width, sizeof(width), 1, stream);
-    fwrite(&height, sizeof(height), 1, stream);
+void Shape::write_to_stream(FILE *stream, bool write_magic, bool compress) const{
+    Profiler::ScopedTimer timer(Profiler::CPU_STREAM_WRITE);
+    ShapeFormat::Header header = ShapeFormat::header_for(width, height, ShapeFormat::FORMAT_FLOAT32);
 
-    fwrite(fragments.data(), sizeof(fragments[0]), fragments.size(), stream);
-
-    if(ferror(stream)){
-        throw std::runtime_error(strerror(errno));
+    if(compress){
+        ShapeCodec::write(stream, header, fragments.data(), write_magic);
+    }
+    else{
+        ShapeFormat::write(stream, header, fragments.data(), write_magic);
     }
 }
 
-void Shape::write_to_file(const char *file) const{
+void Shape::write_to_file(const char *file, bool compress) const{
     FILE *f = fopen(file, "wb");
+    if(!f){
+        throw std::runtime_error(strerror(errno));
+    }
 
     try{
-        write_to_stream(f);
+        write_to_stream(f, true, compress);
         fclose(f);
     }
     catch(std::exception &){
@@ -96,23 +193,125 @@ void Shape::write_to_file(const char *file) const{
 }
 
 void Shape::draw_circle(glm::vec2 circle_pos, float cr) noexcept{
-    for(std::size_t x = 0; x < get_width(); x++){
-        for(std::size_t y = 0; y < get_height(); y++){
-            glm::vec2 gl_pos(
-                2 * x / (float)get_width() - 1.0,
-                2 * y / (float)get_height() - 1.0
-            );
-            
-            float circle_dst = cr - glm::distance(gl_pos, circle_pos);
-            float &prev = fragments[y * get_width() + x];
-
-            if(circle_dst > prev){
-                prev = circle_dst;
+    Profiler::ScopedTimer timer(Profiler::CPU_DRAW_CIRCLE);
+    for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+        for(std::size_t ty = ty_begin; ty < ty_end; ty++){
+            for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                if(circle_reaches_tile(tx, ty, circle_pos, cr)){
+                    draw_circle_tile(tx, ty, circle_pos, cr);
+                }
             }
         }
+    });
+}
+
+void Shape::draw_circles(const Circle *circles, std::size_t count){
+    Profiler::ScopedTimer timer(Profiler::CPU_DRAW_CIRCLES);
+
+    //the bin of tile i is bins[bin_offsets[i], bin_offsets[i] + bin_sizes[i]), every pass sizes the bins
+    //by counting the tiles circles can reach before the bands bin them, so binning never allocates
+    //and the bins only take as much memory as the circles cover tiles
+    std::vector<uint32_t> bins;
+    std::vector<std::size_t> bin_offsets(tiles_x() * tiles_y());
+    std::vector<uint32_t> bin_sizes(tiles_x() * tiles_y());
+
+    for(std::size_t first = 0; first < count; first += CIRCLES_PER_PASS){
+        const Circle *pass = circles + first;
+        std::size_t pass_count = std::min(CIRCLES_PER_PASS, count - first);
+
+        //counting and binning go over the same tiles, so no bin gets more circles than were counted for it
+        float lowest_floor = ShapeKernel::min(floors.data(), floors.size());
+        for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+            count_circles(pass, pass_count, lowest_floor, ty_begin, ty_end, bin_sizes.data());
+        });
+
+        std::size_t total = 0;
+        for(std::size_t tile = 0; tile < bin_sizes.size(); tile++){
+            bin_offsets[tile] = total;
+            total += bin_sizes[tile];
+            bin_sizes[tile] = 0;
+        }
+        if(bins.size() < total) bins.resize(total);
+
+        for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+            bin_circles(pass, pass_count, lowest_floor, ty_begin, ty_end, bins.data(), bin_offsets.data(), bin_sizes.data());
+
+            for(std::size_t ty = ty_begin; ty < ty_end; ty++){
+                for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                    std::size_t tile = ty * tiles_x() + tx;
+                    const uint32_t *bin = bins.data() + bin_offsets[tile];
+
+                    //floor rises while the bin is drawn, so circles are tested again
+                    for(std::size_t i = 0; i < bin_sizes[tile]; i++){
+                        const Circle &circle = pass[bin[i]];
+                        if(circle_reaches_tile(tx, ty, circle.pos, circle.radius)){
+                            draw_circle_tile(tx, ty, circle.pos, circle.radius);
+                        }
+                    }
+                    bin_sizes[tile] = 0;
+                }
+            }
+        });
     }
 }
 
+void Shape::draw_circles(const std::vector<Circle> &circles){
+    draw_circles(circles.data(), circles.size());
+}
+
+void Shape::unite(const Shape &other, float k){
+    combine(other, ShapeKernel::COMBINE_UNION, k);
+}
+
+void Shape::intersect(const Shape &other, float k){
+    combine(other, ShapeKernel::COMBINE_INTERSECT, k);
+}
+
+void Shape::subtract(const Shape &other, float k){
+    combine(other, ShapeKernel::COMBINE_SUBTRACT, k);
+}
+
+void Shape::unite(const Circle &circle, float k){
+    combine(circle, ShapeKernel::COMBINE_UNION, k);
+}
+
+void Shape::intersect(const Circle &circle, float k){
+    combine(circle, ShapeKernel::COMBINE_INTERSECT, k);
+}
+
+void Shape::subtract(const Circle &circle, float k){
+    combine(circle, ShapeKernel::COMBINE_SUBTRACT, k);
+}
+
+void Shape::offset(float distance){
+    if(!isfinite(distance)){
+        throw std::invalid_argument("offset distance is not finite");
+    }
+    if(distance == 0.0f) return;
+
+    Profiler::ScopedTimer timer(Profiler::CPU_CSG);
+    for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+        std::size_t y_end = std::min(ty_end * TILE_SIZE, height);
+        for(std::size_t y = ty_begin * TILE_SIZE; y < y_end; y++){
+            ShapeKernel::add(&fragments[y * width], width, distance);
+        }
+
+        //rounding is monotonic, so the shifted floor is still the exact minimum
+        for(std::size_t tile = ty_begin * tiles_x(); tile < ty_end * tiles_x(); tile++){
+            floors[tile] += distance;
+            dirty[tile] = 1;
+        }
+    });
+}
+
+void Shape::set_thread_pool(ThreadPool *pool) noexcept{
+    this->pool = pool;
+}
+
+ThreadPool *Shape::get_thread_pool() const noexcept{
+    return pool;
+}
+
 std::size_t Shape::get_width() const noexcept{
     return this->width;
 }
@@ -121,43 +320,467 @@ std::size_t Shape::get_height() const noexcept{
     return this->height;
 }
 
+Shape::View Shape::view() const noexcept{
+    return View{fragments.data(), width, height, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+}
+
 void Shape::init_from_stream(FILE *stream){
     std::array<char, 8> magic{};
-    fread(&magic[0], 1, magic.size(), stream);
-
-    if(ferror(stream)){
-        throw std::runtime_error(strerror(errno));
+    if(fread(&magic[0], 1, magic.size(), stream) != magic.size()){
+        ShapeFormat::throw_read_error(stream);
     }
 
-    if(magic != SHAPE_MAGIC){
+    if(magic == ShapeFormat::MAGIC){
+        init_from_stream_without_magic(stream);
+    }
+    else if(magic == ShapeFormat::MAGIC_V1){
+        init_from_v1_stream_without_magic(stream);
+    }
+    else{
         throw std::invalid_argument("shape magic mismatch");
     }
-
-    init_from_stream_without_magic(stream);
 }
 
 void Shape::init_from_stream_without_magic(FILE *stream){
-    uint32_t w, h;
-    fread(&w, sizeof(w), 1, stream);
-    fread(&h, sizeof(h), 1, stream);
+    ShapeFormat::Header header = ShapeFormat::read_header_without_magic(stream);
+
+    width = header.width;
+    height = header.height;
+    this->fragments.resize(width * height);
+
+    if(header.flags & ShapeFormat::FLAG_COMPRESSED){
+        ShapeCodec::Decoder decoder(stream, header);
+        std::vector<uint8_t> block;
+        if(header.format != ShapeFormat::FORMAT_FLOAT32){
+            block.resize(ShapeCodec::BLOCK_ROWS * decoder.row_size());
+        }
+
+        //float32 blocks are decoded in place
+        for(;;){
+            float *rows = fragments.data() + decoder.get_row() * width;
+            std::size_t count = decoder.next(block.empty() ? (void*)rows : block.data());
+            if(count == 0) break;
+
+            if(!block.empty()){
+                ShapeKernel::dequantize(block.data(), rows, count * width, header.format, header.range);
+            }
+        }
+    }
+    else if(header.format == ShapeFormat::FORMAT_FLOAT32){
+        ShapeFormat::read_payload(stream, header, fragments.data());
+    }
+    else{
+        std::vector<uint8_t> payload(header.payload_size);
+        ShapeFormat::read_payload(stream, header, payload.data());
+        ShapeKernel::dequantize(payload.data(), fragments.data(), fragments.size(), header.format, header.range);
+    }
+
+    init_floors();
+}
+
+//v1 stored width and height as 64 bit size_t and fragments in host byte order
+void Shape::init_from_v1_stream_without_magic(FILE *stream){
+    uint64_t w, h;
+    if(fread(&w, sizeof(w), 1, stream) != 1 || fread(&h, sizeof(h), 1, stream) != 1){
+        ShapeFormat::throw_read_error(stream);
+    }
+
+    if(h && w > SIZE_MAX / sizeof(float) / h){
+        throw std::invalid_argument("shape is too large");
+    }
+
     width = w;
     height = h;
-
     this->fragments.resize(width * height);
 
-    for(auto &frag:fragments){
-        fread(&frag, sizeof(frag), 1, stream);
+    if(fread(fragments.data(), sizeof(float), fragments.size(), stream) != fragments.size()){
+        ShapeFormat::throw_read_error(stream);
     }
 
-    if(ferror(stream)){
-        throw std::runtime_error(strerror(errno));
+    init_floors();
+}
+
+std::vector<Shape::Rect> Shape::dirty_rects() const{
+    return tile_rects(dirty);
+}
+
+std::vector<Shape::Rect> Shape::occupied_rects() const{
+    std::vector<uint8_t> mask(tiles_x() * tiles_y());
+    occupied_tiles(mask);
+    return tile_rects(mask);
+}
+
+std::vector<Shape::Rect> Shape::occupied_rects(const Shape &shape1, const Shape &shape2){
+    if(shape1.width != shape2.width || shape1.height != shape2.height){
+        throw std::invalid_argument("shapes differ in size");
+    }
+
+    std::vector<uint8_t> mask(shape1.tiles_x() * shape1.tiles_y());
+    shape1.occupied_tiles(mask);
+    shape2.occupied_tiles(mask);
+    return shape1.tile_rects(mask);
+}
+
+//marks tiles that linear filtering can sample a positive fragment in,
+//so tiles within one fragment of a positive fragment
+void Shape::occupied_tiles(std::vector<uint8_t> &mask) const noexcept{
+    for(std::size_t ty = 0; ty < tiles_y(); ty++){
+        std::size_t y0 = ty * TILE_SIZE;
+        std::size_t y1 = std::min(y0 + TILE_SIZE + 1, height);
+        y0 = y0 > 0 ? y0 - 1 : 0;
+
+        for(std::size_t tx = 0; tx < tiles_x(); tx++){
+            uint8_t &occupied = mask[ty * tiles_x() + tx];
+            if(occupied) continue;
+
+            std::size_t x0 = tx * TILE_SIZE;
+            std::size_t x1 = std::min(x0 + TILE_SIZE + 1, width);
+            x0 = x0 > 0 ? x0 - 1 : 0;
+
+            for(std::size_t y = y0; y < y1 && !occupied; y++){
+                const float *row = &fragments[y * width];
+                occupied = std::any_of(row + x0, row + x1, [](float fragment){
+                    return fragment > 0.0f;
+                });
+            }
+        }
+    }
+}
+
+//merges horizontal runs of marked tiles, then runs with the same span on consecutive rows of tiles
+std::vector<Shape::Rect> Shape::tile_rects(const std::vector<uint8_t> &mask) const{
+    std::vector<Rect> rects;
+    //rects ending at the previous row of tiles, they grow down while the next row has the same run
+    std::size_t open_begin = 0;
+
+    for(std::size_t ty = 0; ty < tiles_y(); ty++){
+        std::size_t y = ty * TILE_SIZE;
+        std::size_t h = std::min(y + TILE_SIZE, height) - y;
+        std::size_t open_end = rects.size();
+
+        for(std::size_t tx = 0; tx < tiles_x(); tx++){
+            if(!mask[ty * tiles_x() + tx]) continue;
+
+            std::size_t run_end = tx;
+            while(run_end < tiles_x() && mask[ty * tiles_x() + run_end]) run_end++;
+
+            std::size_t x = tx * TILE_SIZE;
+            std::size_t w = std::min(run_end * TILE_SIZE, width) - x;
+
+            auto above = std::find_if(rects.begin() + open_begin, rects.begin() + open_end, [&](const Rect &r){
+                return r.x == x && r.width == w;
+            });
+            if(above != rects.begin() + open_end){
+                above->height += h;
+            }
+            else{
+                rects.push_back(Rect{x, y, w, h});
+            }
+
+            tx = run_end;
+        }
+
+        //rects that did not grow are closed
+        std::stable_partition(rects.begin() + open_begin, rects.end(), [&](const Rect &r){
+            return r.y + r.height != y + h;
+        });
+        open_begin = std::find_if(rects.begin() + open_begin, rects.end(), [&](const Rect &r){
+            return r.y + r.height == y + h;
+        }) - rects.begin();
+    }
+
+    return rects;
+}
+
+bool Shape::is_dirty() const noexcept{
+    return std::find(dirty.begin(), dirty.end(), 1) != dirty.end();
+}
+
+void Shape::clear_dirty() noexcept{
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+std::size_t Shape::tiles_x() const noexcept{
+    return (width + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+std::size_t Shape::tiles_y() const noexcept{
+    return (height + TILE_SIZE - 1) / TILE_SIZE;
+}
+
+std::size_t Shape::band_count() const noexcept{
+    return pool ? pool->size() : 1;
+}
+
+void Shape::init_floors(){
+    floors.resize(tiles_x() * tiles_y());
+    dirty.assign(tiles_x() * tiles_y(), 0);
+
+    for(std::size_t ty = 0; ty < tiles_y(); ty++){
+        for(std::size_t tx = 0; tx < tiles_x(); tx++){
+            update_floor(tx, ty);
+        }
+    }
+}
+
+void Shape::update_floor(std::size_t tx, std::size_t ty) noexcept{
+    std::size_t x0 = tx * TILE_SIZE;
+    std::size_t x1 = std::min(x0 + TILE_SIZE, width);
+    std::size_t y0 = ty * TILE_SIZE;
+    std::size_t y1 = std::min(y0 + TILE_SIZE, height);
+
+    float floor = INFINITY;
+    for(std::size_t y = y0; y < y1; y++){
+        floor = std::min(floor, ShapeKernel::min(&fragments[y * width + x0], x1 - x0));
+    }
+
+    floors[ty * tiles_x() + tx] = floor;
+}
+
+bool Shape::circle_reaches_tile(std::size_t tx, std::size_t ty, glm::vec2 circle_pos, float cr) const noexcept{
+    std::size_t x0 = tx * TILE_SIZE;
+    std::size_t x1 = std::min(x0 + TILE_SIZE, width);
+    std::size_t y0 = ty * TILE_SIZE;
+    std::size_t y1 = std::min(y0 + TILE_SIZE, height);
+
+    float dx = std::max({ShapeKernel::fragment_coord(x0, width) - circle_pos.x, 0.0f, circle_pos.x - ShapeKernel::fragment_coord(x1 - 1, width)});
+    float dy = std::max({ShapeKernel::fragment_coord(y0, height) - circle_pos.y, 0.0f, circle_pos.y - ShapeKernel::fragment_coord(y1 - 1, height)});
+
+    return sqrtf(dx * dx + dy * dy) < circle_reach(cr, floors[ty * tiles_x() + tx]);
+}
+
+//calls fn(ty_begin, ty_end) on bands of tile rows, in parallel if there is a pool
+//bands never share a tile, so fn can draw into its rows without locking
+//fn is called at most band_count() times per call
+template<typename Fn>
+void Shape::for_tile_rows(const Fn &fn) noexcept{
+    if(pool){
+        pool->parallel_for(tiles_y(), fn);
+    }
+    else if(tiles_y()){
+        fn(0, tiles_y());
+    }
+}
+
+//combines each tile not skipped with other_row(y, x0, x1, row), the fragments of the other field in row y
+//(row is a scratch row of width fragments, for fields computed on the fly),
+//its floor is the minimum the kernel returns and it is marked dirty if a fragment changed
+template<typename RowFn, typename SkipFn>
+void Shape::combine_tiles(ShapeKernel::CombineOp op, float k, const RowFn &other_row, const SkipFn &skip_tile){
+    if(!(k >= 0.0f) || !isfinite(k)){
+        throw std::invalid_argument("smooth radius is negative or not finite");
+    }
+
+    Profiler::ScopedTimer timer(Profiler::CPU_CSG);
+
+    //scratch of every band, allocated before the bands start so allocation failures throw to the caller
+    struct Scratch{
+        std::vector<float> row;
+        std::vector<float> tile_floors;
+        std::vector<uint8_t> skipped;
+        std::vector<uint8_t> changed;
+    };
+    std::vector<Scratch> bands(band_count());
+    for(Scratch &band:bands){
+        band.row.resize(width);
+        band.tile_floors.resize(tiles_x());
+        band.skipped.resize(tiles_x());
+        band.changed.resize(tiles_x());
+    }
+    std::atomic<std::size_t> next_band{0};
+
+    for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+        Scratch &band = bands[next_band++];
+        std::vector<float> &row = band.row;
+        std::vector<float> &tile_floors = band.tile_floors;
+        std::vector<uint8_t> &skipped = band.skipped;
+        std::vector<uint8_t> &changed = band.changed;
+
+        for(std::size_t ty = ty_begin; ty < ty_end; ty++){
+            for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                tile_floors[tx] = INFINITY;
+                skipped[tx] = skip_tile(tx, ty);
+                changed[tx] = 0;
+            }
+
+            std::size_t y_end = std::min((ty + 1) * TILE_SIZE, height);
+            for(std::size_t y = ty * TILE_SIZE; y < y_end; y++){
+                for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                    if(skipped[tx]) continue;
+
+                    std::size_t x0 = tx * TILE_SIZE;
+                    std::size_t x1 = std::min(x0 + TILE_SIZE, width);
+                    const float *other = other_row(y, x0, x1, row.data());
+
+                    bool tile_changed = false;
+                    float floor = ShapeKernel::combine(&fragments[y * width + x0], other + x0, x1 - x0, op, k, tile_changed);
+                    tile_floors[tx] = std::min(tile_floors[tx], floor);
+                    changed[tx] |= tile_changed;
+                }
+            }
+
+            for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                if(skipped[tx]) continue;
+
+                floors[ty * tiles_x() + tx] = tile_floors[tx];
+                if(changed[tx]) dirty[ty * tiles_x() + tx] = 1;
+            }
+        }
+    });
+}
+
+void Shape::combine(const Shape &other, ShapeKernel::CombineOp op, float k){
+    if(other.width != width || other.height != height){
+        throw std::invalid_argument("shapes differ in size");
+    }
+
+    combine_tiles(op, k, [&](std::size_t y, std::size_t, std::size_t, float *){
+        return &other.fragments[y * width];
+    }, [](std::size_t, std::size_t){
+        return false;
+    });
+}
+
+//circle fragments are made by circle_span over a row of -INFINITY, exactly the values draw_circle compares
+void Shape::combine(const Circle &circle, ShapeKernel::CombineOp op, float k){
+    if(op == ShapeKernel::COMBINE_UNION && k == 0.0f){
+        draw_circle(circle.pos, circle.radius);
+        return;
+    }
+
+    combine_tiles(op, k, [&](std::size_t y, std::size_t x0, std::size_t x1, float *row){
+        float dy = ShapeKernel::fragment_coord(y, height) - circle.pos.y;
+        std::fill(row + x0, row + x1, -INFINITY);
+        ShapeKernel::circle_span(row, x0, x1, (float)width, circle.pos.x, dy * dy, circle.radius);
+        return (const float*)row;
+    }, [&](std::size_t tx, std::size_t ty){
+        //a smooth union only changes fragments the circle field gets within k of
+        return op == ShapeKernel::COMBINE_UNION && !circle_reaches_tile(tx, ty, circle.pos, circle.radius + k);
+    });
+}
+
+void Shape::fill_rows(RowFill fill, const void *ctx) noexcept{
+    Profiler::ScopedTimer timer(Profiler::CPU_FILL);
+    std::atomic<std::size_t> next_band{0};
+
+    for_tile_rows([&](std::size_t ty_begin, std::size_t ty_end){
+        std::size_t band = next_band++;
+        for(std::size_t ty = ty_begin; ty < ty_end; ty++){
+            std::size_t y0 = ty * TILE_SIZE;
+            fill(ctx, band, Rect{0, y0, width, std::min(TILE_SIZE, height - y0)}, fragments.data());
+
+            //the rows were just written, so their floors are computed while still in cache
+            for(std::size_t tx = 0; tx < tiles_x(); tx++){
+                update_floor(tx, ty);
+                dirty[ty * tiles_x() + tx] = 1;
+            }
+        }
+    });
+}
+
+//tiles of rows [ty_begin, ty_end) within the reach of the circle over fragments above floor,
+//[tx_begin, tx_end) x [ty_first, ty_last), false if there are none
+bool Shape::circle_tiles(const Circle &circle, float floor, std::size_t ty_begin, std::size_t ty_end, std::size_t &tx_begin, std::size_t &tx_end, std::size_t &ty_first, std::size_t &ty_last) const noexcept{
+    float reach = circle_reach(circle.radius, floor);
+    if(!(reach > 0.0f)) return false;
+
+    std::size_t x_begin, x_end, y_begin, y_end;
+    fragment_range(circle.pos.x, reach, width, x_begin, x_end);
+    fragment_range(circle.pos.y, reach, height, y_begin, y_end);
+    if(x_begin == x_end || y_begin == y_end) return false;
+
+    tx_begin = x_begin / TILE_SIZE;
+    tx_end = (x_end - 1) / TILE_SIZE + 1;
+    ty_first = std::max(y_begin / TILE_SIZE, ty_begin);
+    ty_last = std::min((y_end - 1) / TILE_SIZE + 1, ty_end);
+    return ty_first < ty_last;
+}
+
+//adds to bin_sizes of tile rows [ty_begin, ty_end) the circles whose reach over fragments above floor covers the tile,
+//at least as many as bin_circles puts there with the same floor
+void Shape::count_circles(const Circle *circles, std::size_t count, float floor, std::size_t ty_begin, std::size_t ty_end, uint32_t *bin_sizes) const noexcept{
+    for(std::size_t i = 0; i < count; i++){
+        std::size_t tx_begin, tx_end, ty_first, ty_last;
+        if(!circle_tiles(circles[i], floor, ty_begin, ty_end, tx_begin, tx_end, ty_first, ty_last)) continue;
+
+        for(std::size_t ty = ty_first; ty < ty_last; ty++){
+            for(std::size_t tx = tx_begin; tx < tx_end; tx++){
+                bin_sizes[ty * tiles_x() + tx]++;
+            }
+        }
+    }
+}
+
+//appends to each bin of tile rows [ty_begin, ty_end) the indices of circles that can reach the tile,
+//floor is at most the floors of the tiles, bin_offsets are where the bins start in bins, bin_sizes the entries in use
+void Shape::bin_circles(const Circle *circles, std::size_t count, float floor, std::size_t ty_begin, std::size_t ty_end, uint32_t *bins, const std::size_t *bin_offsets, uint32_t *bin_sizes) const noexcept{
+    for(std::size_t i = 0; i < count; i++){
+        std::size_t tx_begin, tx_end, ty_first, ty_last;
+        if(!circle_tiles(circles[i], floor, ty_begin, ty_end, tx_begin, tx_end, ty_first, ty_last)) continue;
+
+        for(std::size_t ty = ty_first; ty < ty_last; ty++){
+            for(std::size_t tx = tx_begin; tx < tx_end; tx++){
+                if(circle_reaches_tile(tx, ty, circles[i].pos, circles[i].radius)){
+                    std::size_t tile = ty * tiles_x() + tx;
+                    bins[bin_offsets[tile] + bin_sizes[tile]++] = (uint32_t)i;
+                }
+            }
+        }
+    }
+}
+
+//visits only the columns of each tile row that lie within the reach of the circle,
+//then tightens the tile floor
+void Shape::draw_circle_tile(std::size_t tx, std::size_t ty, glm::vec2 circle_pos, float cr) noexcept{
+    std::size_t x0 = tx * TILE_SIZE;
+    std::size_t x1 = std::min(x0 + TILE_SIZE, width);
+    std::size_t y0 = ty * TILE_SIZE;
+    std::size_t y1 = std::min(y0 + TILE_SIZE, height);
+
+    double reach = circle_reach(cr, floors[ty * tiles_x() + tx]);
+
+    for(std::size_t y = y0; y < y1; y++){
+        float dy = ShapeKernel::fragment_coord(y, height) - circle_pos.y;
+        float dy2 = dy * dy;
+
+        double rest = reach * reach - dy2;
+        if(rest < 0.0) continue;
+
+        std::size_t begin, end;
+        fragment_range(circle_pos.x, sqrt(rest), width, begin, end);
+        begin = std::clamp(begin, x0, x1);
+        end = std::clamp(end, x0, x1);
+
+        ShapeKernel::circle_span(&fragments[y * width], begin, end, (float)width, circle_pos.x, dy2, cr);
     }
+
+    update_floor(tx, ty);
+    dirty[ty * tiles_x() + tx] = 1;
 }
 
 
 Shape::Renderer::Renderer() noexcept{
     _is_init = false;
     rel_to_width = false;
+    premultiplied = false;
+    quad_buffer = 0;
+    instance_buffer = 0;
+    batch_texture = 0;
+    batch_viewport_scale = 0;
+    render_vertex_array = 0;
+    morph_vertex_array = 0;
+    pair_vertex_array = 0;
+    tight_render_vertex_array = 0;
+    tight_morph_vertex_array = 0;
+    batch_vertex_array = 0;
+    bake_vertex_array = 0;
+    bake_framebuffer = 0;
+    in_frame = false;
+    frame_viewport_scale = 0;
+    gpu_queries.fill(0);
+    gpu_query_first = 0;
+    gpu_query_count = 0;
+    forget_bindings();
 }
 
 Shape::Renderer::~Renderer() noexcept{
@@ -172,95 +795,227 @@ void Shape::Renderer::init(){
         throw std::logic_error("already initialized");
     }
 
-    GlUtil::Shader vert = GlUtil::Shader::compile_new(
-    GL_VERTEX_SHADER,
-    R"GLSL(
-        #version 110
+    for(Variant &variant: variants){
+        variant.failed = false;
+    }
+    build_variant(0);
+    build_variant(VARIANT_MORPH);
+    build_variant(VARIANT_PACKED_MORPH);
+    if(premultiplied) build_premultiplied();
+
+    const char *vert = R"GLSL(
+        #version 130
 
-        attribute vec4 v_pos;
-        uniform mat4 v_mvp;
-        uniform mat4 v_tex_mvp;
-        
-        varying vec2 f_pos;
-        varying vec2 f_uvpos;
+        in vec4 v_pos;
+        in vec4 v_color;
+        in vec4 v_params;
+        in mat4 v_mvp;
+        in mat4 v_tex_mvp;
+
+        out vec2 f_uvpos;
+        flat out vec4 f_color;
+        flat out vec4 f_params;
 
         void main(){
             vec4 pos = v_pos * v_mvp;
             f_uvpos = (vec4(v_pos.xy, 1, 1) * v_tex_mvp).xy  * vec2(0.5) + vec2(0.5);
-            f_pos = pos.xy;
+            f_color = v_color;
+            f_params = v_params;
             gl_Position = pos;
         }
-    )GLSL");
+    )GLSL";
 
-    GlUtil::Shader frag = GlUtil::Shader::compile_new(
-    GL_FRAGMENT_SHADER,
-    R"GLSL(
-        #version 110
+    const char *frag = R"GLSL(
+        #version 130
 
-        uniform vec4 f_color;
-        uniform float f_power;
-        uniform sampler2D f_shape;
+        uniform sampler2DArray f_shapes;
 
-        varying vec2 f_pos;
-        varying vec2 f_uvpos;
+        in vec2 f_uvpos;
+        flat in vec4 f_color;
+        //power, progress, layer1, layer2
+        flat in vec4 f_params;
 
         void main(){
-            float mask = clamp(texture2D(f_shape, f_uvpos).r * f_power, -1.0, 1.0) * f_color.a;
+            float shape = texture(f_shapes, vec3(f_uvpos, f_params.z)).r;
+            if(f_params.z != f_params.w){
+                shape = mix(shape, texture(f_shapes, vec3(f_uvpos, f_params.w)).r, f_params.y);
+            }
+            float mask = clamp(shape * f_params.x, -1.0, 1.0) * f_color.a;
             gl_FragColor = vec4(f_color.rgb, mask);
         }
-    )GLSL");
+    )GLSL";
 
-    prog_render = GlUtil::Program::link_new(vert, frag);
+    //v_pos at generic attribute 0, which compatibility profiles need enabled to issue vertices
+    prog_batch = GlUtil::Program::build(vert, frag, "", {"v_pos"});
 
-    frag.delete_shader();
-    frag = GlUtil::Shader::compile_new(
-    GL_FRAGMENT_SHADER,
-    R"GLSL(
-        #version 110
+    pb_v_pos = prog_batch.attrib_location("v_pos");
+    pb_v_color = prog_batch.attrib_location("v_color");
+    pb_v_params = prog_batch.attrib_location("v_params");
+    pb_v_mvp = prog_batch.attrib_location("v_mvp");
+    pb_v_tex_mvp = prog_batch.attrib_location("v_tex_mvp");
+    pb_f_shapes = prog_batch.uniform_location("f_shapes");
 
-        uniform vec4 f_color;
-        uniform float f_power;
-        uniform sampler2D f_shape1;
-        uniform sampler2D f_shape2;
-        uniform float f_progress;
+    vert = R"GLSL(
+        #version 130
 
-        varying vec2 f_pos;
-        varying vec2 f_uvpos;
+        in vec4 v_pos;
 
         void main(){
-            float shape = mix(texture2D(f_shape1, f_uvpos).r, texture2D(f_shape2, f_uvpos).r, f_progress);
-            float mask = clamp(shape * f_power, -1.0, 1.0) * f_color.a;
-            gl_FragColor = vec4(f_color.rgb, mask);
+            gl_Position = v_pos;
+        }
+    )GLSL";
+
+    //fragment coordinates match ShapeKernel::fragment_coord: 2 * x / width - 1 for the fragment column x
+    frag = R"GLSL(
+        #version 130
+
+        //x, y, radius
+        uniform vec3 f_circles[128];
+        uniform int f_count;
+        uniform vec2 f_size;
+
+        float circle(vec2 pos, vec3 c){
+            vec2 d = pos - c.xy;
+            return c.z - sqrt(d.x * d.x + d.y * d.y);
         }
-    )GLSL");
-    
-    prog_morph = GlUtil::Program::link_new(vert, frag);
-
-    vert.delete_shader();
-    frag.delete_shader();
-
-    pr_v_pos = prog_render.attrib_location("v_pos");
-    pr_v_mvp = prog_render.uniform_location("v_mvp");
-    pr_v_tex_mvp = prog_render.uniform_location("v_tex_mvp");
-    pr_f_color = prog_render.uniform_location("f_color");
-    pr_f_power = prog_render.uniform_location("f_power");
-    pr_f_shape = prog_render.uniform_location("f_shape");
-
-    pm_v_pos = prog_morph.attrib_location("v_pos");
-    pm_v_mvp = prog_morph.uniform_location("v_mvp");
-    pm_v_tex_mvp = prog_morph.uniform_location("v_tex_mvp");
-    pm_f_color = prog_morph.uniform_location("f_color");
-    pm_f_power = prog_morph.uniform_location("f_power");
-    pm_f_shape1 = prog_morph.uniform_location("f_shape1");
-    pm_f_shape2 = prog_morph.uniform_location("f_shape2");
-    pm_f_progress = prog_morph.uniform_location("f_progress");
+
+        void main(){
+            vec2 pos = (gl_FragCoord.xy - vec2(0.5)) * vec2(2.0) / f_size - vec2(1.0);
+
+            float value = circle(pos, f_circles[0]);
+            for(int i = 1; i < f_count; i++){
+                value = max(value, circle(pos, f_circles[i]));
+            }
+            gl_FragColor = vec4(value);
+        }
+    )GLSL";
+
+    prog_bake = GlUtil::Program::build(vert, frag, "", {"v_pos"});
+
+    pk_v_pos = prog_bake.attrib_location("v_pos");
+    pk_f_circles = prog_bake.uniform_location("f_circles");
+    pk_f_count = prog_bake.uniform_location("f_count");
+    pk_f_size = prog_bake.uniform_location("f_size");
+
+    float vertices[] = {
+        -1.0, 1.0, 1.0, 1.0, 1.0, -1.0,
+        -1.0, 1.0, -1.0, -1.0, 1.0, -1.0,
+    };
+    glGenBuffers(1, &quad_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glGenBuffers(1, &instance_buffer);
+
+    //specialized variants are only used with the v_pos location of their family
+    glGenVertexArrays(1, &render_vertex_array);
+    glBindVertexArray(render_vertex_array);
+    glEnableVertexAttribArray(variants[0].v_pos);
+    glVertexAttribPointer(variants[0].v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glGenVertexArrays(1, &morph_vertex_array);
+    glBindVertexArray(morph_vertex_array);
+    glEnableVertexAttribArray(variants[VARIANT_MORPH].v_pos);
+    glVertexAttribPointer(variants[VARIANT_MORPH].v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    //tight geometry is pointed to in every draw
+    glGenVertexArrays(1, &tight_render_vertex_array);
+    glBindVertexArray(tight_render_vertex_array);
+    glEnableVertexAttribArray(variants[0].v_pos);
+
+    glGenVertexArrays(1, &tight_morph_vertex_array);
+    glBindVertexArray(tight_morph_vertex_array);
+    glEnableVertexAttribArray(variants[VARIANT_MORPH].v_pos);
+
+    glGenVertexArrays(1, &pair_vertex_array);
+    glBindVertexArray(pair_vertex_array);
+    glEnableVertexAttribArray(variants[VARIANT_PACKED_MORPH].v_pos);
+    glVertexAttribPointer(variants[VARIANT_PACKED_MORPH].v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glGenVertexArrays(1, &batch_vertex_array);
+    glBindVertexArray(batch_vertex_array);
+    glEnableVertexAttribArray(pb_v_pos);
+    glVertexAttribPointer(pb_v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    //a mat4 attribute takes 4 locations, one per column
+    std::array<std::pair<GLint, std::size_t>, 10> instance_attributes{{
+        {pb_v_color, offsetof(Instance, color)},
+        {pb_v_params, offsetof(Instance, params)},
+        {pb_v_mvp + 0, offsetof(Instance, mvp) + 0 * sizeof(glm::vec4)},
+        {pb_v_mvp + 1, offsetof(Instance, mvp) + 1 * sizeof(glm::vec4)},
+        {pb_v_mvp + 2, offsetof(Instance, mvp) + 2 * sizeof(glm::vec4)},
+        {pb_v_mvp + 3, offsetof(Instance, mvp) + 3 * sizeof(glm::vec4)},
+        {pb_v_tex_mvp + 0, offsetof(Instance, tex_mvp) + 0 * sizeof(glm::vec4)},
+        {pb_v_tex_mvp + 1, offsetof(Instance, tex_mvp) + 1 * sizeof(glm::vec4)},
+        {pb_v_tex_mvp + 2, offsetof(Instance, tex_mvp) + 2 * sizeof(glm::vec4)},
+        {pb_v_tex_mvp + 3, offsetof(Instance, tex_mvp) + 3 * sizeof(glm::vec4)},
+    }};
+
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    for(const auto &[location, offset]: instance_attributes){
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const void*)offset);
+        glVertexAttribDivisor(location, 1);
+    }
+
+    glGenVertexArrays(1, &bake_vertex_array);
+    glBindVertexArray(bake_vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+    glEnableVertexAttribArray(pk_v_pos);
+    glVertexAttribPointer(pk_v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenFramebuffers(1, &bake_framebuffer);
+
+    //samplers always read the same texture units
+    prog_batch.use();
+    glUniform1i(pb_f_shapes, 0);
+    prog_batch.unuse();
+
+    in_frame = false;
+    forget_bindings();
 
     _is_init = true;
 }
 
 void Shape::Renderer::uninit(){
     if(is_init()){
-        prog_render.delete_program();
+        for(Variant &variant: variants){
+            if(variant.program.id()) variant.program.delete_program();
+            variant.failed = false;
+        }
+        prog_batch.delete_program();
+        prog_bake.delete_program();
+        glDeleteFramebuffers(1, &bake_framebuffer);
+        glDeleteVertexArrays(1, &bake_vertex_array);
+        bake_framebuffer = 0;
+        bake_vertex_array = 0;
+        glDeleteBuffers(1, &quad_buffer);
+        glDeleteBuffers(1, &instance_buffer);
+        glDeleteVertexArrays(1, &render_vertex_array);
+        glDeleteVertexArrays(1, &morph_vertex_array);
+        glDeleteVertexArrays(1, &pair_vertex_array);
+        glDeleteVertexArrays(1, &tight_render_vertex_array);
+        glDeleteVertexArrays(1, &tight_morph_vertex_array);
+        glDeleteVertexArrays(1, &batch_vertex_array);
+        quad_buffer = 0;
+        instance_buffer = 0;
+        render_vertex_array = 0;
+        morph_vertex_array = 0;
+        pair_vertex_array = 0;
+        tight_render_vertex_array = 0;
+        tight_morph_vertex_array = 0;
+        batch_vertex_array = 0;
+        if(gpu_queries[0]){
+            glDeleteQueries(gpu_queries.size(), gpu_queries.data());
+            gpu_queries.fill(0);
+        }
+        gpu_query_first = 0;
+        gpu_query_count = 0;
+        batch.clear();
+        in_frame = false;
+        forget_bindings();
 
         _is_init = false;
     }
@@ -273,38 +1028,24 @@ bool Shape::Renderer::is_init() const noexcept{
     return _is_init;
 }
 
-void Shape::Renderer::render(GLuint shape_texture, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept{
-    if(!is_init()) return;
-
-    GLint vp[4];
-    glGetIntegerv(GL_VIEWPORT, vp);
+void Shape::Renderer::begin_frame(GLsizei width, GLsizei height) noexcept{
+    frame_viewport_scale = rel_to_width ? width : height;
+    in_frame = true;
+    forget_bindings();
+}
 
-    float actual_power;
-    if(rel_to_width) actual_power = vp[2] * power;
-    else actual_power = vp[3] * power;
-
-    prog_render.use();
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, shape_texture);
-
-    glUniform1i(pr_f_shape, 0);
-    glUniform4f(pr_f_color, color.r, color.g, color.b, color.a);
-    glUniform1f(pr_f_power, actual_power);
-    glUniformMatrix4fv(pr_v_mvp, 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(pr_v_tex_mvp, 1, GL_FALSE, &tex_mvp[0][0]);
-    
-    glEnableVertexAttribArray(pr_v_pos);
-    float vertices[] = {
-        -1.0, 1.0, 1.0, 1.0, 1.0, -1.0,
-        -1.0, 1.0, -1.0, -1.0, 1.0, -1.0,
-    };
-    glVertexAttribPointer(pr_v_pos, 2, GL_FLOAT, GL_FALSE, 0, vertices);
+void Shape::Renderer::end_frame() noexcept{
+    unbind();
+    in_frame = false;
+    collect_gpu_timers();
+    Profiler::next_frame();
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+void Shape::Renderer::render(GLuint shape_texture, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept{
+    if(!is_init()) return;
 
-    glDisableVertexAttribArray(pr_v_pos);
-    prog_render.unuse();
-    glBindTexture(GL_TEXTURE_2D, 0);
+    bind_texture(GL_TEXTURE_2D, 0, shape_texture);
+    draw_variant(0, render_vertex_array, 0, color, power, 0, mvp, tex_mvp, 6);
 }
 
 void Shape::Renderer::render(GLuint shape_texture, const glm::vec4 &color, float power, const glm::mat4 &mvp) const noexcept{
@@ -319,40 +1060,15 @@ void Shape::Renderer::render(GLuint shape_texture, const glm::vec4 &color, float
 void Shape::Renderer::render_morph(GLuint shape_texture1, GLuint shape_texture2, const glm::vec4 &color , float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept{
     if(!is_init()) return;
 
-    GLint vp[4];
-    glGetIntegerv(GL_VIEWPORT, vp);
-
-    float actual_power;
-    if(rel_to_width) actual_power = vp[2] * power;
-    else actual_power = vp[3] * power;
-
-    prog_morph.use();
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, shape_texture1);
-
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, shape_texture2);
-
-    glUniform1i(pm_f_shape1, 0);
-    glUniform1i(pm_f_shape2, 1);
-    glUniform4f(pm_f_color, color.r, color.g, color.b, color.a);
-    glUniform1f(pm_f_power, actual_power);
-    glUniform1f(pm_f_progress, progress);
-    glUniformMatrix4fv(pm_v_mvp, 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(pm_v_tex_mvp, 1, GL_FALSE, &tex_mvp[0][0]);
-    
-    glEnableVertexAttribArray(pm_v_pos);
-    float vertices[] = {
-        -1.0, 1.0, 1.0, 1.0, 1.0, -1.0,
-        -1.0, 1.0, -1.0, -1.0, 1.0, -1.0,
-    };
-    glVertexAttribPointer(pm_v_pos, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    //mix gives exactly one of the shapes at the ends, so only that one is fetched
+    if(progress == 0.0f || progress == 1.0f){
+        render(progress == 0.0f ? shape_texture1 : shape_texture2, color, power, mvp, tex_mvp);
+        return;
+    }
 
-    glDisableVertexAttribArray(pm_v_pos);
-    prog_morph.unuse();
-    glBindTexture(GL_TEXTURE_2D, 0);
+    bind_texture(GL_TEXTURE_2D, 0, shape_texture1);
+    bind_texture(GL_TEXTURE_2D, 1, shape_texture2);
+    draw_variant(VARIANT_MORPH, morph_vertex_array, 0, color, power, progress, mvp, tex_mvp, 6);
 }
 
 void Shape::Renderer::render_morph(GLuint shape_texture1, GLuint shape_texture2, const glm::vec4 &color , float power, float progress, const glm::mat4 &mvp) const noexcept{
@@ -363,12 +1079,639 @@ void Shape::Renderer::render_morph(GLuint shape_texture1, GLuint shape_texture2,
     render_morph(shape_texture1, shape_texture2, color, power, progress, IDENTITY, IDENTITY);
 }
 
+void Shape::Renderer::render_tight(GLuint shape_texture, GLuint geometry, GLsizei vertices, const glm::vec4 &color, float power, const glm::mat4 &mvp) const noexcept{
+    if(!is_init()) return;
+
+    bind_texture(GL_TEXTURE_2D, 0, shape_texture);
+    draw_variant(0, tight_render_vertex_array, geometry, color, power, 0, mvp, IDENTITY, vertices);
+}
+
+void Shape::Renderer::render_morph_tight(GLuint shape_texture1, GLuint shape_texture2, GLuint geometry, GLsizei vertices, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp) const noexcept{
+    if(!is_init()) return;
+
+    if(progress == 0.0f || progress == 1.0f){
+        render_tight(progress == 0.0f ? shape_texture1 : shape_texture2, geometry, vertices, color, power, mvp);
+        return;
+    }
+
+    bind_texture(GL_TEXTURE_2D, 0, shape_texture1);
+    bind_texture(GL_TEXTURE_2D, 1, shape_texture2);
+    draw_variant(VARIANT_MORPH, tight_morph_vertex_array, geometry, color, power, progress, mvp, IDENTITY, vertices);
+}
+
+GLsizei Shape::Renderer::geometry_buffer(const std::vector<Shape::Rect> &rects, std::size_t width, std::size_t height, GLuint &buffer) const{
+    std::vector<float> vertices;
+    vertices.reserve(rects.size() * 12);
+
+    //same winding as the full quad
+    for(const Shape::Rect &rect: rects){
+        float x0 = 2.0f * rect.x / width - 1.0f;
+        float x1 = 2.0f * (rect.x + rect.width) / width - 1.0f;
+        float y0 = 2.0f * rect.y / height - 1.0f;
+        float y1 = 2.0f * (rect.y + rect.height) / height - 1.0f;
+        vertices.insert(vertices.end(), {
+            x0, y1, x1, y1, x1, y0,
+            x0, y1, x0, y0, x1, y0,
+        });
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, vertices.size() * sizeof(float));
+    return vertices.size() / 2;
+}
+
+void Shape::Renderer::render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept{
+    if(!is_init()) return;
+
+    bind_texture(GL_TEXTURE_2D, 0, pair_texture);
+    draw_variant(VARIANT_PACKED_MORPH, pair_vertex_array, 0, color, power, progress, mvp, tex_mvp, 6);
+}
+
+void Shape::Renderer::render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp) const noexcept{
+    render_morph_pair(pair_texture, color, power, progress, mvp, IDENTITY);
+}
+
+void Shape::Renderer::render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress) const noexcept{
+    render_morph_pair(pair_texture, color, power, progress, IDENTITY, IDENTITY);
+}
+
+void Shape::Renderer::set_premultiplied(bool premultiplied){
+    if(premultiplied && is_init()) build_premultiplied();
+    this->premultiplied = premultiplied;
+}
+
+bool Shape::Renderer::is_premultiplied() const noexcept{
+    return premultiplied;
+}
+
 void Shape::Renderer::shape_texture(const Shape &shape, GLuint &texture) const noexcept{
+    shape_texture(shape.view(), texture);
+}
+
+void Shape::Renderer::shape_texture(const Shape::View &shape, GLuint &texture) const noexcept{
+    Profiler::ScopedTimer timer(Profiler::CPU_SHAPE_TEXTURE);
+    Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, shape.width * shape.height * ShapeFormat::fragment_size(shape.format));
+
+    GLint internal_format;
+    GLenum type;
+    texture_format(shape.format, internal_format, type);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_texture_parameters(GL_TEXTURE_2D);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, shape.width, shape.height, 0, GL_RED, type, shape.fragments);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+}
+
+void Shape::Renderer::shape_texture_and_clear_dirty(Shape &shape, GLuint &texture) const noexcept{
+    shape_texture(shape.view(), texture);
+    shape.clear_dirty();
+}
+
+void Shape::Renderer::morph_pair_texture(const Shape &shape1, const Shape &shape2, GLuint &texture, ShapeFormat::Format format) const{
+    morph_pair_texture(shape1.view(), shape2.view(), texture, format);
+}
+
+void Shape::Renderer::morph_pair_texture(const Shape::View &shape1, const Shape::View &shape2, GLuint &texture, ShapeFormat::Format format) const{
+    if(shape1.width != shape2.width || shape1.height != shape2.height){
+        throw std::invalid_argument("morph pair shapes differ in size");
+    }
+    if(format != ShapeFormat::FORMAT_FLOAT32 && format != ShapeFormat::FORMAT_FLOAT16){
+        throw std::invalid_argument("morph pairs are stored in float formats");
+    }
+
+    std::size_t count = shape1.width * shape1.height;
+    std::vector<float> first(count), second(count), pair(2 * count);
+    ShapeKernel::dequantize(shape1.fragments, first.data(), count, shape1.format, shape1.range);
+    ShapeKernel::dequantize(shape2.fragments, second.data(), count, shape2.format, shape2.range);
+    for(std::size_t i = 0; i < count; i++){
+        pair[2 * i] = first[i];
+        pair[2 * i + 1] = second[i];
+    }
+
+    GLint internal_format = GL_RG32F;
+    GLenum type = GL_FLOAT;
+    const void *pixels = pair.data();
+    std::vector<uint16_t> halves;
+    if(format == ShapeFormat::FORMAT_FLOAT16){
+        internal_format = GL_RG16F;
+        type = GL_HALF_FLOAT;
+        halves.resize(pair.size());
+        ShapeKernel::quantize(pair.data(), halves.data(), pair.size(), format, 1.0f);
+        pixels = halves.data();
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_texture_parameters(GL_TEXTURE_2D);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, shape1.width, shape1.height, 0, GL_RG, type, pixels);
+    Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, count * 2 * (halves.empty() ? sizeof(float) : sizeof(uint16_t)));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+}
+
+void Shape::Renderer::stream_texture(FILE *stream, GLuint &texture) const{
+    std::array<char, 8> magic{};
+    if(fread(&magic[0], 1, magic.size(), stream) != magic.size()){
+        ShapeFormat::throw_read_error(stream);
+    }
+
+    if(magic != ShapeFormat::MAGIC){
+        throw std::invalid_argument("shape magic mismatch");
+    }
+
+    ShapeFormat::Header header = ShapeFormat::read_header_without_magic(stream);
+    ShapeCodec::Decoder decoder(stream, header);
+    std::vector<uint8_t> staging(ShapeCodec::BLOCK_ROWS * decoder.row_size());
+
+    GLint internal_format;
+    GLenum type;
+    texture_format(header.format, internal_format, type);
+
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, shape.get_width(), shape.get_height(), 0, GL_RED, GL_FLOAT, shape.fragments.data());
+    set_texture_parameters(GL_TEXTURE_2D);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, header.width, header.height, 0, GL_RED, type, nullptr);
+
+    try{
+        for(;;){
+            std::size_t first_row = decoder.get_row();
+            std::size_t rows = decoder.next(staging.data());
+            if(rows == 0) break;
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, header.width, rows, GL_RED, type, staging.data());
+            Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, rows * decoder.row_size());
+        }
+    }
+    catch(std::exception &){
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        forget_bindings();
+        throw;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+}
+
+void Shape::Renderer::pyramid_texture(const ShapePyramid &pyramid, GLuint &texture, std::size_t base_level) const noexcept{
+    base_level = std::min(base_level, pyramid.get_levels() - 1);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_texture_parameters(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramid.get_levels() - 1 - base_level);
+
+    for(std::size_t level = base_level; level < pyramid.get_levels(); level++){
+        Shape::View view = pyramid.level(level);
+        glTexImage2D(GL_TEXTURE_2D, level - base_level, GL_R32F, view.width, view.height, 0, GL_RED, GL_FLOAT, view.fragments);
+        Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, view.width * view.height * sizeof(float));
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+}
+
+void Shape::Renderer::update_texture(Shape &shape, GLuint texture) const{
+    std::vector<Shape::Rect> rects = shape.dirty_rects();
+    if(rects.empty()) return;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, shape.width);
+    for(const Shape::Rect &rect: rects){
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RED, GL_FLOAT,
+            &shape.fragments[rect.y * shape.width + rect.x]);
+        Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, rect.width * rect.height * sizeof(float));
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+
+    shape.clear_dirty();
+}
+
+void Shape::Renderer::shape_texture_array(const std::vector<Shape::View> &shapes, GLuint &texture) const{
+    if(shapes.empty()){
+        throw std::invalid_argument("no shapes");
+    }
+
+    const Shape::View &first = shapes[0];
+    for(const Shape::View &shape: shapes){
+        if(shape.width != first.width || shape.height != first.height || shape.format != first.format){
+            throw std::invalid_argument("shapes differ in size or format");
+        }
+    }
+
+    GLint internal_format;
+    GLenum type;
+    texture_format(first.format, internal_format, type);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    set_texture_parameters(GL_TEXTURE_2D_ARRAY);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, first.width, first.height, shapes.size(), 0, GL_RED, type, nullptr);
+    for(std::size_t layer = 0; layer < shapes.size(); layer++){
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, first.width, first.height, 1, GL_RED, type, shapes[layer].fragments);
+    }
+    Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, shapes.size() * first.width * first.height * ShapeFormat::fragment_size(first.format));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    forget_bindings();
+}
+
+void Shape::Renderer::begin(GLuint shape_texture_array) noexcept{
+    batch.clear();
+    batch_texture = shape_texture_array;
+    batch_viewport_scale = viewport_scale();
+}
+
+void Shape::Renderer::submit(GLint layer, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp){
+    batch.push_back(Instance{color, glm::vec4(batch_viewport_scale * power, 0, layer, layer), mvp, tex_mvp});
+}
+
+void Shape::Renderer::submit_morph(GLint layer1, GLint layer2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp){
+    batch.push_back(Instance{color, glm::vec4(batch_viewport_scale * power, progress, layer1, layer2), mvp, tex_mvp});
+}
+
+void Shape::Renderer::flush() noexcept{
+    if(!is_init() || batch.empty()) return;
+
+    use(prog_batch, batch_vertex_array);
+    bind_texture(GL_TEXTURE_2D_ARRAY, 0, batch_texture);
+
+    //orphans the previous contents, so the driver does not wait for the last flush to finish
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, batch.size() * sizeof(Instance), batch.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    bool timed = begin_gpu_timer(Profiler::GPU_BATCH);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, batch.size());
+    end_gpu_timer(timed);
+    Profiler::count(Profiler::COUNTER_DRAWS);
+    Profiler::count(Profiler::COUNTER_UPLOAD_BYTES, batch.size() * sizeof(Instance));
+
+    release();
+    batch.clear();
+}
+
+void Shape::Renderer::bake_circles(const Shape::Circle *circles, std::size_t count, GLsizei width, GLsizei height, GLuint &texture, ShapeFormat::Format format){
+    if(format != ShapeFormat::FORMAT_FLOAT32 && format != ShapeFormat::FORMAT_FLOAT16){
+        throw std::invalid_argument("shapes are baked to float formats");
+    }
+    if(!is_init()) return;
+
+    GLint internal_format;
+    GLenum type;
+    texture_format(format, internal_format, type);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_texture_parameters(GL_TEXTURE_2D);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RED, type, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+
+    GLint framebuffer;
+    GLint vp[4];
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    GLboolean color_mask[4];
+    GLint blend_rgb, blend_alpha;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, vp);
+    glGetIntegerv(GL_BLEND_EQUATION_RGB, &blend_rgb);
+    glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &blend_alpha);
+    glGetBooleanv(GL_COLOR_WRITEMASK, color_mask);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, bake_framebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glViewport(0, 0, width, height);
+    //the clear and the passes obey both, the whole texture is baked whatever the caller set
+    glDisable(GL_SCISSOR_TEST);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    //an empty union is -INFINITY everywhere, as a new Shape
+    const GLfloat empty[4] = {-INFINITY, -INFINITY, -INFINITY, -INFINITY};
+    glClearBufferfv(GL_COLOR, 0, empty);
+
+    glEnable(GL_BLEND);
+    glBlendEquation(GL_MAX);
+
+    use(prog_bake, bake_vertex_array);
+    glUniform2f(pk_f_size, width, height);
+    Profiler::count(Profiler::COUNTER_UNIFORMS);
+    bool timed = begin_gpu_timer(Profiler::GPU_BAKE);
+
+    std::array<GLfloat, BAKE_CIRCLES_PER_PASS * 3> pass;
+    for(std::size_t first = 0; first < count; first += BAKE_CIRCLES_PER_PASS){
+        std::size_t pass_count = std::min(BAKE_CIRCLES_PER_PASS, count - first);
+        for(std::size_t i = 0; i < pass_count; i++){
+            pass[i * 3 + 0] = circles[first + i].pos.x;
+            pass[i * 3 + 1] = circles[first + i].pos.y;
+            pass[i * 3 + 2] = circles[first + i].radius;
+        }
+
+        glUniform3fv(pk_f_circles, pass_count, pass.data());
+        glUniform1i(pk_f_count, pass_count);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        Profiler::count(Profiler::COUNTER_UNIFORMS, 2);
+        Profiler::count(Profiler::COUNTER_DRAWS);
+    }
+    end_gpu_timer(timed);
+
+    release();
+
+    glBlendEquationSeparate(blend_rgb, blend_alpha);
+    if(!blend) glDisable(GL_BLEND);
+    if(scissor) glEnable(GL_SCISSOR_TEST);
+    glColorMask(color_mask[0], color_mask[1], color_mask[2], color_mask[3]);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glViewport(vp[0], vp[1], vp[2], vp[3]);
+}
+
+void Shape::Renderer::bake_circles(const std::vector<Shape::Circle> &circles, GLsizei width, GLsizei height, GLuint &texture, ShapeFormat::Format format){
+    bake_circles(circles.data(), circles.size(), width, height, texture, format);
+}
+
+Shape Shape::Renderer::read_shape(GLuint texture) const{
+    GLint width, height;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+
+    Shape shape(width, height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, shape.fragments.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    forget_bindings();
+
+    shape.init_floors();
+    return shape;
+}
+
+float Shape::Renderer::viewport_scale() const noexcept{
+    if(in_frame) return frame_viewport_scale;
+
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    return rel_to_width ? vp[2] : vp[3];
+}
+
+unsigned Shape::Renderer::variant_flags(unsigned family, const glm::vec4 &color, float power) const noexcept{
+    unsigned flags = family;
+    if(color.a == 1.0f) flags |= VARIANT_NO_ALPHA;
+    if(power == INFINITY) flags |= VARIANT_PIXELATED;
+    if(premultiplied) flags |= VARIANT_PREMULTIPLIED;
+    return flags;
+}
+
+Shape::Renderer::Variant &Shape::Renderer::variant(unsigned flags) const noexcept{
+    Variant &result = variants[flags];
+    if(result.program.id() == 0 && !result.failed){
+        try{
+            build_variant(flags);
+        }
+        catch(std::exception &){
+            result.failed = true;
+        }
+    }
+
+    if(!result.failed) return result;
+    //the unspecialized programs of the required flags are built by init and set_premultiplied
+    return (flags & VARIANT_OPTIONAL) ? variant(flags & ~VARIANT_OPTIONAL) : variants[flags & VARIANT_REQUIRED];
+}
+
+void Shape::Renderer::build_premultiplied() const{
+    for(unsigned family: {0u, (unsigned)VARIANT_MORPH, (unsigned)VARIANT_PACKED_MORPH}){
+        Variant &result = variants[family | VARIANT_PREMULTIPLIED];
+        if(result.program.id() != 0) continue;
+
+        build_variant(family | VARIANT_PREMULTIPLIED);
+        result.failed = false;
+    }
+}
+
+void Shape::Renderer::build_variant(unsigned flags) const{
+    static const std::array<std::pair<VariantFlag, const char *>, 5> defines{{
+        {VARIANT_MORPH, "#define MORPH\n"},
+        {VARIANT_PACKED_MORPH, "#define PACKED_MORPH\n"},
+        {VARIANT_NO_ALPHA, "#define NO_ALPHA\n"},
+        {VARIANT_PIXELATED, "#define PIXELATED\n"},
+        {VARIANT_PREMULTIPLIED, "#define PREMULTIPLIED\n"},
+    }};
+
+    std::string flag_defines;
+    for(const auto &[flag, define]: defines){
+        if(flags & flag) flag_defines += define;
+    }
+
+    Variant &result = variants[flags];
+    result.program = GlUtil::Program::build(RENDER_VERTEX_SHADER, RENDER_FRAGMENT_SHADER, flag_defines, {"v_pos"});
+    result.v_pos = result.program.attrib_location("v_pos");
+    result.v_mvp = result.program.uniform_location("v_mvp");
+    result.v_tex_mvp = result.program.uniform_location("v_tex_mvp");
+    result.f_color = result.program.uniform_location("f_color");
+    result.f_power = result.program.uniform_location("f_power");
+    result.f_progress = result.program.uniform_location("f_progress");
+    //nan never compares equal, so the first draw uploads every uniform
+    result.uploaded = Uniforms{glm::vec4(NAN), NAN, NAN, glm::mat4(NAN), glm::mat4(NAN)};
+
+    //specialized programs share the vertex arrays of their family
+    const Variant &family = variants[flags & (VARIANT_MORPH | VARIANT_PACKED_MORPH)];
+    if(&family != &result && result.v_pos != family.v_pos){
+        result.program.delete_program();
+        throw std::runtime_error("variant attribute location differs from its family");
+    }
+
+    //samplers always read the same texture units
+    result.program.use();
+    glUniform1i(result.program.uniform_location("f_shape1"), 0);
+    glUniform1i(result.program.uniform_location("f_shape2"), 1);
+    if(bindings.program != UNKNOWN) bindings.program = result.program.id();
+}
+
+//the textures of the family must be bound
+void Shape::Renderer::draw_variant(unsigned family, GLuint vertex_array, GLuint geometry, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp, GLsizei vertices) const noexcept{
+    Variant &program = variant(variant_flags(family, color, power));
+    float actual_power = viewport_scale() * power;
+
+    use(program.program, vertex_array);
+    if(geometry){
+        glBindBuffer(GL_ARRAY_BUFFER, geometry);
+        glVertexAttribPointer(program.v_pos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    set_uniforms(Uniforms{color, actual_power, progress, mvp, tex_mvp}, program.uploaded, program.f_color, program.f_power,
+        family ? program.f_progress : -1, program.v_mvp, program.v_tex_mvp);
+
+    bool timed = begin_gpu_timer(Profiler::GPU_RENDER);
+    glDrawArrays(GL_TRIANGLES, 0, vertices);
+    end_gpu_timer(timed);
+    Profiler::count(Profiler::COUNTER_DRAWS);
+
+    release();
+}
+
+void Shape::Renderer::use(const GlUtil::Program &program, GLuint vertex_array) const noexcept{
+    if(bindings.program != program.id()){
+        program.use();
+        bindings.program = program.id();
+        Profiler::count(Profiler::COUNTER_BINDS);
+    }
+    if(bindings.vertex_array != vertex_array){
+        glBindVertexArray(vertex_array);
+        bindings.vertex_array = vertex_array;
+        Profiler::count(Profiler::COUNTER_BINDS);
+    }
+}
+
+//texture arrays are only bound to unit 0
+void Shape::Renderer::bind_texture(GLenum target, GLuint unit, GLuint texture) const noexcept{
+    GLuint &bound = target == GL_TEXTURE_2D_ARRAY ? bindings.texture_array : bindings.textures[unit];
+    if(bound == texture) return;
+
+    if(bindings.active_texture != GL_TEXTURE0 + unit){
+        glActiveTexture(GL_TEXTURE0 + unit);
+        bindings.active_texture = GL_TEXTURE0 + unit;
+    }
+    glBindTexture(target, texture);
+    bound = texture;
+    Profiler::count(Profiler::COUNTER_BINDS);
+}
+
+//uploads the values that differ from uploaded, for the program in use
+void Shape::Renderer::set_uniforms(const Uniforms &values, Uniforms &uploaded, GLint color, GLint power, GLint progress, GLint mvp, GLint tex_mvp) const noexcept{
+    if(values.color != uploaded.color){
+        glUniform4f(color, values.color.r, values.color.g, values.color.b, values.color.a);
+        Profiler::count(Profiler::COUNTER_UNIFORMS);
+    }
+    if(values.power != uploaded.power){
+        glUniform1f(power, values.power);
+        Profiler::count(Profiler::COUNTER_UNIFORMS);
+    }
+    if(progress != -1 && values.progress != uploaded.progress){
+        glUniform1f(progress, values.progress);
+        Profiler::count(Profiler::COUNTER_UNIFORMS);
+    }
+    if(values.mvp != uploaded.mvp){
+        glUniformMatrix4fv(mvp, 1, GL_FALSE, &values.mvp[0][0]);
+        Profiler::count(Profiler::COUNTER_UNIFORMS);
+    }
+    if(values.tex_mvp != uploaded.tex_mvp){
+        glUniformMatrix4fv(tex_mvp, 1, GL_FALSE, &values.tex_mvp[0][0]);
+        Profiler::count(Profiler::COUNTER_UNIFORMS);
+    }
+    uploaded = values;
+}
+
+void Shape::Renderer::release() const noexcept{
+    if(!in_frame) unbind();
+}
+
+//unbinds what the renderer knows it has bound
+void Shape::Renderer::unbind() const noexcept{
+    for(GLuint unit = 0; unit < bindings.textures.size(); unit++){
+        if(bindings.textures[unit] == 0 || bindings.textures[unit] == UNKNOWN) continue;
+
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        bindings.active_texture = GL_TEXTURE0 + unit;
+    }
+    if(bindings.texture_array != 0 && bindings.texture_array != UNKNOWN){
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        bindings.active_texture = GL_TEXTURE0;
+    }
+    if(bindings.active_texture != GL_TEXTURE0 && bindings.active_texture != UNKNOWN){
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if(bindings.vertex_array != 0 && bindings.vertex_array != UNKNOWN){
+        glBindVertexArray(0);
+    }
+    if(bindings.program != 0 && bindings.program != UNKNOWN){
+        glUseProgram(0);
+    }
+    forget_bindings();
+}
+
+void Shape::Renderer::forget_bindings() const noexcept{
+    bindings = Bindings{UNKNOWN, UNKNOWN, UNKNOWN, {UNKNOWN, UNKNOWN}, UNKNOWN};
+}
+
+//time elapsed queries do not nest, so draws inside someone else's query are not timed
+bool Shape::Renderer::begin_gpu_timer(Profiler::GpuTimer timer) const noexcept{
+    if(!Profiler::is_enabled()) return false;
+
+    collect_gpu_timers();
+
+    GLint active = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_CURRENT_QUERY, &active);
+    if(active != 0 || gpu_query_count == gpu_queries.size()){
+        Profiler::drop_gpu_timing();
+        return false;
+    }
+
+    if(!gpu_queries[0]){
+        glGenQueries(gpu_queries.size(), gpu_queries.data());
+    }
+
+    std::size_t slot = (gpu_query_first + gpu_query_count) % gpu_queries.size();
+    gpu_query_timers[slot] = timer;
+    gpu_query_count++;
+    glBeginQuery(GL_TIME_ELAPSED, gpu_queries[slot]);
+    return true;
+}
+
+void Shape::Renderer::end_gpu_timer(bool began) const noexcept{
+    if(began) glEndQuery(GL_TIME_ELAPSED);
+}
+
+void Shape::Renderer::collect_gpu_timers() const noexcept{
+    while(gpu_query_count){
+        GLuint query = gpu_queries[gpu_query_first];
+
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        Profiler::record(gpu_query_timers[gpu_query_first], ns * 1e-6);
+
+        gpu_query_first = (gpu_query_first + 1) % gpu_queries.size();
+        gpu_query_count--;
+    }
+}
+
+void Shape::Renderer::texture_format(ShapeFormat::Format format, GLint &internal_format, GLenum &type) noexcept{
+    switch (format){
+    case ShapeFormat::FORMAT_FLOAT16:
+        internal_format = GL_R16F;
+        type = GL_HALF_FLOAT;
+        break;
+    case ShapeFormat::FORMAT_SNORM16:
+        internal_format = GL_R16_SNORM;
+        type = GL_SHORT;
+        break;
+    case ShapeFormat::FORMAT_SNORM8:
+        internal_format = GL_R8_SNORM;
+        type = GL_BYTE;
+        break;
+    default:
+        internal_format = GL_R32F;
+        type = GL_FLOAT;
+        break;
+    }
+}
+
+void Shape::Renderer::set_texture_parameters(GLenum target) noexcept{
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 }
@@ -7,33 +7,156 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "glutil/Program.hpp"
+#include "ShapeFormat.hpp"
+#include "ShapeKernel.hpp"
+#include "Profiler.hpp"
+
+class ThreadPool;
+class ShapePyramid;
 
 class Shape{
 public:
     class Renderer;
 
+    struct Circle{
+        glm::vec2 pos;
+        float radius;
+    };
+
+    //rectangle of fragments
+    struct Rect{
+        std::size_t x;
+        std::size_t y;
+        std::size_t width;
+        std::size_t height;
+    };
+
+    //read only fragments of a shape, owned by a Shape, QuantizedShape or MappedShape
+    struct View{
+        const void *fragments;
+        std::size_t width;
+        std::size_t height;
+        ShapeFormat::Format format;
+        //normalized formats store fragment / range
+        float range;
+    };
+
     Shape(std::size_t width, std::size_t height) noexcept;
     Shape(FILE *stream, bool magic = true);
     Shape(std::vector<uint8_t> data, bool magic = true);
     Shape(const char *file);
+    //dequantizes views of other formats
+    Shape(const View &view);
     virtual ~Shape() noexcept = default;
 
-    void write_to_stream(FILE *stream, bool write_magic = true) const;
-    void write_to_file(const char *file) const;
+    //writes the v2 format, see ShapeFormat.hpp, compress codes the payload with ShapeCodec
+    void write_to_stream(FILE *stream, bool write_magic = true, bool compress = false) const;
+    void write_to_file(const char *file, bool compress = false) const;
 
     //uses cpu
     void draw_circle(glm::vec2 circle_pos, float cr) noexcept;
 
+    //uses cpu, same result as draw_circle for each circle in order,
+    //but bins circles by tile and goes through the field once per CIRCLES_PER_PASS circles
+    void draw_circles(const Circle *circles, std::size_t count);
+    void draw_circles(const std::vector<Circle> &circles);
+
+    //fragment by fragment csg in one pass over the field, fields are positive inside:
+    //unite keeps max(fragment, other), intersect min(fragment, other) and subtract min(fragment, -other),
+    //a smooth radius k > 0 rounds the crease where the fields are within k of each other (polynomial smooth min)
+    //the other shape must be of the same size, invalid_argument otherwise or if k is negative or not finite
+    void unite(const Shape &other, float k = 0.0f);
+    void intersect(const Shape &other, float k = 0.0f);
+    void subtract(const Shape &other, float k = 0.0f);
+    //the same with the field of a circle, unite skips the tiles the circle cannot reach (k = 0 is draw_circle)
+    void unite(const Circle &circle, float k = 0.0f);
+    void intersect(const Circle &circle, float k = 0.0f);
+    void subtract(const Circle &circle, float k = 0.0f);
+    //adds distance to every fragment, growing (positive) or insetting (negative) the shape,
+    //which on a distance field also rounds its convex corners by distance
+    //invalid_argument if distance is not finite
+    void offset(float distance);
+
+    //replaces every fragment: fill(band, rows, fragments) writes the fragments of rows, one row of TILE_SIZE tiles
+    //across the whole width per call (in parallel if there is a pool), into fragments, the row major field,
+    //then the floors of those tiles are updated and the whole shape is marked dirty
+    //calls of one band < band_count() run one after another on one thread, so fill can use scratch
+    //allocated per band beforehand, fill must not throw
+    //ShapeExpr::bake evaluates expressions through it
+    template<typename Fn>
+    void fill(const Fn &fn) noexcept{
+        fill_rows([](const void *ctx, std::size_t band, const Rect &rows, float *fragments){
+            (*static_cast<const Fn*>(ctx))(band, rows, fragments);
+        }, &fn);
+    }
+
+    //draw operations split the field into bands of tile rows, one per pool thread
+    //nullptr (default) or a pool of size 1 draws on the calling thread
+    void set_thread_pool(ThreadPool *pool) noexcept;
+    ThreadPool *get_thread_pool() const noexcept;
+    //most bands draw operations split the field into, the pool size or 1
+    std::size_t band_count() const noexcept;
+
     std::size_t get_width() const noexcept;
     std::size_t get_height() const noexcept;
+
+    //fragments draw operations may have changed since construction (or clear_dirty),
+    //tracked by TILE_SIZE tiles and merged into as few rectangles as rows of tiles allow
+    std::vector<Rect> dirty_rects() const;
+    bool is_dirty() const noexcept;
+    void clear_dirty() noexcept;
+
+    //fragments whose area can get positive alpha when the shape texture is rendered with linear filtering:
+    //TILE_SIZE tiles within one fragment of a positive fragment, merged like dirty_rects
+    //negative alpha clamps to zero in fixed point color buffers, so elsewhere the shape draws nothing there
+    std::vector<Rect> occupied_rects() const;
+    //union for morphs of the two shapes, invalid_argument if they differ in size
+    static std::vector<Rect> occupied_rects(const Shape &shape1, const Shape &shape2);
+
+    //invalidated by anything that resizes the shape
+    View view() const noexcept;
 protected:
     std::vector<float> fragments;
 private:
+    //side of the square fragment tiles draw operations are culled by
+    static constexpr std::size_t TILE_SIZE = 32;
+    //circles binned at once by draw_circles
+    static constexpr std::size_t CIRCLES_PER_PASS = 256;
+
     void init_from_stream(FILE *stream);
     void init_from_stream_without_magic(FILE *stream);
+    void init_from_v1_stream_without_magic(FILE *stream);
+
+    std::size_t tiles_x() const noexcept;
+    std::size_t tiles_y() const noexcept;
+    void init_floors();
+    void update_floor(std::size_t tx, std::size_t ty) noexcept;
+    bool circle_reaches_tile(std::size_t tx, std::size_t ty, glm::vec2 circle_pos, float cr) const noexcept;
+    void draw_circle_tile(std::size_t tx, std::size_t ty, glm::vec2 circle_pos, float cr) noexcept;
+    void occupied_tiles(std::vector<uint8_t> &mask) const noexcept;
+    std::vector<Rect> tile_rects(const std::vector<uint8_t> &mask) const;
+    bool circle_tiles(const Circle &circle, float floor, std::size_t ty_begin, std::size_t ty_end, std::size_t &tx_begin, std::size_t &tx_end, std::size_t &ty_first, std::size_t &ty_last) const noexcept;
+    void count_circles(const Circle *circles, std::size_t count, float floor, std::size_t ty_begin, std::size_t ty_end, uint32_t *bin_sizes) const noexcept;
+    void bin_circles(const Circle *circles, std::size_t count, float floor, std::size_t ty_begin, std::size_t ty_end, uint32_t *bins, const std::size_t *bin_offsets, uint32_t *bin_sizes) const noexcept;
+    template<typename Fn>
+    void for_tile_rows(const Fn &fn) noexcept;
+    template<typename RowFn, typename SkipFn>
+    void combine_tiles(ShapeKernel::CombineOp op, float k, const RowFn &other_row, const SkipFn &skip_tile);
+    void combine(const Shape &other, ShapeKernel::CombineOp op, float k);
+    void combine(const Circle &circle, ShapeKernel::CombineOp op, float k);
+    typedef void (*RowFill)(const void *ctx, std::size_t band, const Rect &rows, float *fragments);
+    void fill_rows(RowFill fill, const void *ctx) noexcept;
 
     std::size_t width;
     std::size_t height;
+
+    //lower bound of fragments in each tile,
+    //a draw operation can only change fragments of the tile if it can get above its floor
+    std::vector<float> floors;
+    //tiles changed since clear_dirty, one byte per tile so threads drawing other tiles never share one
+    std::vector<uint8_t> dirty;
+
+    ThreadPool *pool;
 };
 
 class Shape::Renderer{
@@ -49,6 +172,15 @@ public:
     //can be called to destroy in spcific place (for better managing GlContext)
     void uninit();
 
+    //sets the viewport size render power is relative to and starts caching gl state:
+    //until end_frame the renderer assumes nothing else changes the bound program, vertex array,
+    //active texture unit or the textures of units 0 and 1, and skips redundant binds
+    //outside of a frame every render call reads GL_VIEWPORT and unbinds everything it bound
+    void begin_frame(GLsizei width, GLsizei height) noexcept;
+    //unbinds what the frame bound, call before other gl code touches the state cached in a frame
+    //with Profiler enabled also closes its frame counters and collects finished gpu timers
+    void end_frame() noexcept;
+
     void render(GLuint shape_texture, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept;
     void render(GLuint shape_texture, const glm::vec4 &color, float power, const glm::mat4 &mvp) const noexcept;
     void render(GLuint shape_texture, const glm::vec4 &color, float power) const noexcept;
@@ -56,26 +188,219 @@ public:
     void render_morph(GLuint shape_texture1, GLuint shape_texture2, const glm::vec4 &color , float power, float progress, const glm::mat4 &mvp) const noexcept;
     void render_morph(GLuint shape_texture1, GLuint shape_texture2, const glm::vec4 &color , float power, float progress) const noexcept;
 
+    //render and render_morph covering only the geometry made by geometry_buffer, instead of the full quad
+    //(with the identity tex_mvp), in fixed point color buffers the same image (up to interpolation rounding)
+    //with fewer shaded fragments
+    void render_tight(GLuint shape_texture, GLuint geometry, GLsizei vertices, const glm::vec4 &color, float power, const glm::mat4 &mvp = IDENTITY) const noexcept;
+    void render_morph_tight(GLuint shape_texture1, GLuint shape_texture2, GLuint geometry, GLsizei vertices, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp = IDENTITY) const noexcept;
+    //fills buffer with triangles covering rects of a width x height shape (see Shape::occupied_rects), returns the vertex count
+    GLsizei geometry_buffer(const std::vector<Shape::Rect> &rects, std::size_t width, std::size_t height, GLuint &buffer) const;
+
+    //render_morph of a pair packed by morph_pair_texture, one texture and one fetch per fragment
+    void render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp) const noexcept;
+    void render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp) const noexcept;
+    void render_morph_pair(GLuint pair_texture, const glm::vec4 &color, float power, float progress) const noexcept;
+
+    //render and render_morph programs are specialized per draw: color.a == 1 skips the alpha scale,
+    //an infinite power takes the sign of the shape instead of scaling and clamping it,
+    //a morph at progress 0 or 1 fetches only the shape it shows, specialized programs are compiled on first use
+    //premultiplied output gives color.rgb * mask, for glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA),
+    //with the mask clamped to [0, 1], batches stay straight alpha
+    //runtime_error if the premultiplied programs do not build, the output then stays as it was
+    void set_premultiplied(bool premultiplied);
+    bool is_premultiplied() const noexcept;
+
     void shape_texture(const Shape &shape, GLuint &texture) const noexcept;
+    //uploads with the internal format matching the view (GL_R32F, GL_R16F, GL_R16_SNORM, GL_R8_SNORM)
+    //normalized formats sample as fragment / range, so scale the render power by range
+    void shape_texture(const Shape::View &shape, GLuint &texture) const noexcept;
+    //shape_texture, then clears the dirty set so update_texture sends only later changes,
+    //for a shape kept in this one texture (other textures of the shape would miss the cleared changes)
+    void shape_texture_and_clear_dirty(Shape &shape, GLuint &texture) const noexcept;
+
+    //packs two same sized shapes into one GL_RG32F (FORMAT_FLOAT32) or GL_RG16F (FORMAT_FLOAT16) texture,
+    //shape1 in .r and shape2 in .g, for render_morph_pair
+    //invalid_argument if the shapes differ in size or the format is not a float one
+    void morph_pair_texture(const Shape &shape1, const Shape &shape2, GLuint &texture, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32) const;
+    void morph_pair_texture(const Shape::View &shape1, const Shape::View &shape2, GLuint &texture, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32) const;
+
+    //uploads a v2 shape stream (magic included) block by block, without loading the whole shape
+    //runtime_error on stream errors, invalid_argument if the stream is not a valid v2 shape
+    void stream_texture(FILE *stream, GLuint &texture) const;
+
+    //uploads levels [base_level, levels) of the pyramid as the mip levels of texture, with trilinear filtering
+    //a base_level above 0 streams only the coarse levels, e.g. for distant shapes
+    void pyramid_texture(const ShapePyramid &pyramid, GLuint &texture, std::size_t base_level = 0) const noexcept;
+
+    //uploads the dirty rects of the shape into texture, which must already hold the shape
+    //in a float format (see shape_texture), and clears the dirty set
+    void update_texture(Shape &shape, GLuint texture) const;
+
+    //uploads same sized shapes of one format as the layers of a GL_TEXTURE_2D_ARRAY, for batches
+    //invalid_argument if shapes is empty or the shapes differ in size or format
+    void shape_texture_array(const std::vector<Shape::View> &shapes, GLuint &texture) const;
+
+    //batched rendering of layers of one texture array, see shape_texture_array
+    //everything submitted until flush is drawn with one instanced draw call, in submission order
+    //the viewport is read once, in begin (or taken from begin_frame)
+    void begin(GLuint shape_texture_array) noexcept;
+    void submit(GLint layer, const glm::vec4 &color, float power, const glm::mat4 &mvp = IDENTITY, const glm::mat4 &tex_mvp = IDENTITY);
+    void submit_morph(GLint layer1, GLint layer2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp = IDENTITY, const glm::mat4 &tex_mvp = IDENTITY);
+    //draws the submitted instances, the batch stays open for further submits
+    void flush() noexcept;
+
+    //bakes the union of the circles into texture (reallocated to width x height) on the gpu,
+    //the same field Shape(width, height).draw_circles gives up to float rounding,
+    //format is FORMAT_FLOAT32 (GL_R32F) or FORMAT_FLOAT16 (GL_R16F), invalid_argument for others
+    //bakes whole textures whatever the scissor test and color mask, restores the framebuffer, viewport,
+    //blending, scissor test and color mask it changes
+    void bake_circles(const Shape::Circle *circles, std::size_t count, GLsizei width, GLsizei height, GLuint &texture, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32);
+    void bake_circles(const std::vector<Shape::Circle> &circles, GLsizei width, GLsizei height, GLuint &texture, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32);
+
+    //reads a shape texture back (e.g. a baked one, to save it), normalized formats read as fragment / range
+    Shape read_shape(GLuint texture) const;
+
     bool is_init() const noexcept;
+
+    //internal format and pixel type shape textures of the format are uploaded with
+    static void texture_format(ShapeFormat::Format format, GLint &internal_format, GLenum &type) noexcept;
+    //filtering and wrapping of shape textures, for the texture bound to target
+    static void set_texture_parameters(GLenum target) noexcept;
 private:
-    GlUtil::Program prog_render;
-        GLint pr_v_pos;
-        GLint pr_v_mvp;
-        GLint pr_v_tex_mvp;
-        GLint pr_f_color;
-        GLint pr_f_power;
-        GLint pr_f_shape;
-    
-    GlUtil::Program prog_morph;
-        GLint pm_v_pos;
-        GLint pm_v_mvp;
-        GLint pm_v_tex_mvp;
-        GLint pm_f_color;
-        GLint pm_f_power;
-        GLint pm_f_shape1;
-        GLint pm_f_shape2;
-        GLint pm_f_progress;
+    //per instance attributes of prog_batch
+    struct Instance{
+        glm::vec4 color;
+        //power, progress, layer1, layer2
+        glm::vec4 params;
+        glm::mat4 mvp;
+        glm::mat4 tex_mvp;
+    };
+
+    //last values uploaded to the uniforms of a program
+    struct Uniforms{
+        glm::vec4 color;
+        float power;
+        float progress;
+        glm::mat4 mvp;
+        glm::mat4 tex_mvp;
+    };
+
+    //gl bindings as left by the renderer, UNKNOWN if they may have been changed by someone else
+    struct Bindings{
+        GLuint program;
+        GLuint vertex_array;
+        GLenum active_texture;
+        std::array<GLuint, 2> textures;
+        GLuint texture_array;
+    };
+
+    //render program specialized by a mask of VARIANT_ flags
+    struct Variant{
+        GlUtil::Program program;
+        GLint v_pos;
+        GLint v_mvp;
+        GLint v_tex_mvp;
+        GLint f_color;
+        GLint f_power;
+        GLint f_progress;
+        Uniforms uploaded;
+        //did not build, draws fall back to a less specialized variant
+        bool failed;
+    };
+
+    inline static const GLuint UNKNOWN = ~(GLuint)0;
+    //circles evaluated by one bake pass, passes are combined by GL_MAX blending
+    static constexpr std::size_t BAKE_CIRCLES_PER_PASS = 128;
+    //GL_TIME_ELAPSED queries in flight for Profiler gpu timers
+    static constexpr std::size_t GPU_TIMER_QUERIES = 32;
+
+    //#defines of the render fragment shader, a draw uses the variant of the most flags that hold for it
+    enum VariantFlag: unsigned{
+        //two shape textures mixed by progress
+        VARIANT_MORPH = 1,
+        //one pair texture (morph_pair_texture) mixed by progress
+        VARIANT_PACKED_MORPH = 2,
+        //color.a is 1, the mask is not scaled by it
+        VARIANT_NO_ALPHA = 4,
+        //infinite power, the sign of the fragment is the mask (the pixel look with GL_NEAREST filtering)
+        VARIANT_PIXELATED = 8,
+        //set_premultiplied
+        VARIANT_PREMULTIPLIED = 16,
+    };
+    static constexpr std::size_t VARIANT_COUNT = 32;
+    //flags only making a draw cheaper, dropped if a variant does not build
+    static constexpr unsigned VARIANT_OPTIONAL = VARIANT_NO_ALPHA | VARIANT_PIXELATED;
+    //flags every draw keeps, the unspecialized programs of each are built before they are drawn with
+    static constexpr unsigned VARIANT_REQUIRED = VARIANT_MORPH | VARIANT_PACKED_MORPH | VARIANT_PREMULTIPLIED;
+
+    float viewport_scale() const noexcept;
+    //flags of a draw of the family (0, VARIANT_MORPH or VARIANT_PACKED_MORPH)
+    unsigned variant_flags(unsigned family, const glm::vec4 &color, float power) const noexcept;
+    //builds the variant if needed, a variant that does not build falls back to one without the optional flags,
+    //so draws keep their family and VARIANT_PREMULTIPLIED
+    Variant &variant(unsigned flags) const noexcept;
+    //runtime_error if doesnt compile or link
+    void build_variant(unsigned flags) const;
+    //builds the unspecialized premultiplied programs of the families if needed (by init or set_premultiplied)
+    //runtime_error if one does not build
+    void build_premultiplied() const;
+    //geometry (if not 0) is pointed to by the vertex array, for tight draws
+    void draw_variant(unsigned family, GLuint vertex_array, GLuint geometry, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp, GLsizei vertices) const noexcept;
+    void use(const GlUtil::Program &program, GLuint vertex_array) const noexcept;
+    void bind_texture(GLenum target, GLuint unit, GLuint texture) const noexcept;
+    void set_uniforms(const Uniforms &values, Uniforms &uploaded, GLint color, GLint power, GLint progress, GLint mvp, GLint tex_mvp) const noexcept;
+    //unbinds everything if not in a frame
+    void release() const noexcept;
+    void unbind() const noexcept;
+    void forget_bindings() const noexcept;
+    //begins a query for the Profiler gpu timer, false if Profiler is disabled or the timing is dropped
+    bool begin_gpu_timer(Profiler::GpuTimer timer) const noexcept;
+    void end_gpu_timer(bool began) const noexcept;
+    //records the finished queries, oldest first, stopping at the first one still running so it never waits
+    void collect_gpu_timers() const noexcept;
+
+    GlUtil::Program prog_batch;
+        GLint pb_v_pos;
+        GLint pb_v_color;
+        GLint pb_v_params;
+        GLint pb_v_mvp;
+        GLint pb_v_tex_mvp;
+        GLint pb_f_shapes;
+
+    GlUtil::Program prog_bake;
+        GLint pk_v_pos;
+        GLint pk_f_circles;
+        GLint pk_f_count;
+        GLint pk_f_size;
+
+    GLuint quad_buffer;
+    GLuint instance_buffer;
+    GLuint render_vertex_array;
+    GLuint morph_vertex_array;
+    GLuint pair_vertex_array;
+    GLuint tight_render_vertex_array;
+    GLuint tight_morph_vertex_array;
+    GLuint batch_vertex_array;
+    GLuint bake_vertex_array;
+    GLuint bake_framebuffer;
+
+    //built on first use, the unspecialized ones (0, VARIANT_MORPH, VARIANT_PACKED_MORPH) by init,
+    //their VARIANT_PREMULTIPLIED ones by init or set_premultiplied
+    mutable std::array<Variant, VARIANT_COUNT> variants;
+    bool premultiplied;
+    mutable Bindings bindings;
+    bool in_frame;
+    float frame_viewport_scale;
+
+    //ring of queries, gpu_query_count of them in flight from gpu_query_first, names created on first use
+    mutable std::array<GLuint, GPU_TIMER_QUERIES> gpu_queries;
+    mutable std::array<Profiler::GpuTimer, GPU_TIMER_QUERIES> gpu_query_timers;
+    mutable std::size_t gpu_query_first;
+    mutable std::size_t gpu_query_count;
+
+    std::vector<Instance> batch;
+    GLuint batch_texture;
+    float batch_viewport_scale;
 
     bool rel_to_width;
     bool _is_init;
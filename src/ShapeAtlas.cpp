@@ -0,0 +1,321 @@
+#include "ShapeAtlas.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+ShapeAtlas::ShapeAtlas(GLsizei size, GLsizei layers, ShapeFormat::Format format, float range, GLsizei gutter){
+    if(size <= 0 || layers <= 0 || gutter < 0 || gutter >= size / 2){
+        throw std::invalid_argument("invalid atlas size");
+    }
+
+    ShapeFormat::Header header = ShapeFormat::header_for(size, size, format, range);
+
+    this->size = size;
+    this->layers = layers;
+    this->gutter = gutter;
+    this->format = format;
+    this->range = header.range;
+    this->shelves.resize(layers);
+    this->used_area = 0;
+    this->next_handle = 0;
+    this->frame = 0;
+
+    GLint internal_format;
+    GLenum type;
+    Shape::Renderer::texture_format(format, internal_format, type);
+
+    GLint bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    Shape::Renderer::set_texture_parameters(GL_TEXTURE_2D_ARRAY);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal_format, size, size, layers, 0, GL_RED, type, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bound);
+}
+
+ShapeAtlas::~ShapeAtlas() noexcept{
+    glDeleteTextures(1, &_texture);
+}
+
+ShapeAtlas::Handle ShapeAtlas::add(const Shape::View &shape){
+    if(shape.width + 2 * gutter > (std::size_t)size || shape.height + 2 * gutter > (std::size_t)size){
+        throw std::invalid_argument("shape is bigger than the atlas layers");
+    }
+
+    QuantizedShape copy(shape, format, range);
+    GLsizei width = shape.width + 2 * gutter;
+    GLsizei height = shape.height + 2 * gutter;
+
+    GLint layer;
+    std::size_t shelf;
+    GLsizei x, y;
+    bool compacted = false;
+    while(!place(width, height, layer, shelf, x, y)){
+        if(!compacted && free_area() >= (std::size_t)width * height){
+            compact();
+            compacted = true;
+        }
+        else if(evict_one()){
+            compacted = false;
+        }
+        else{
+            throw std::runtime_error("shape atlas is full");
+        }
+    }
+
+    Handle handle = next_handle++;
+    Entry &entry = entries.emplace(handle, Entry{std::move(copy), Region{}, 0, frame}).first->second;
+    locate(entry, layer, shelf, x, y);
+
+    try{
+        upload(entry);
+    }
+    catch(std::exception &){
+        release(entry);
+        entries.erase(handle);
+        throw;
+    }
+    return handle;
+}
+
+ShapeAtlas::Handle ShapeAtlas::add(const Shape &shape){
+    return add(shape.view());
+}
+
+void ShapeAtlas::remove(Handle handle){
+    release(find(handle));
+    entries.erase(handle);
+}
+
+bool ShapeAtlas::contains(Handle handle) const noexcept{
+    return entries.count(handle) != 0;
+}
+
+const ShapeAtlas::Region &ShapeAtlas::region(Handle handle) const{
+    return find(handle).region;
+}
+
+const ShapeAtlas::Region &ShapeAtlas::use(Handle handle){
+    Entry &entry = find(handle);
+    entry.last_use = frame;
+    return entry.region;
+}
+
+void ShapeAtlas::next_frame() noexcept{
+    frame++;
+}
+
+void ShapeAtlas::compact(){
+    std::vector<std::pair<Handle, Entry*>> order;
+    order.reserve(entries.size());
+    for(auto &[handle, entry]: entries){
+        order.emplace_back(handle, &entry);
+    }
+
+    std::sort(order.begin(), order.end(), [](const auto &a, const auto &b){
+        const Region &ra = a.second->region;
+        const Region &rb = b.second->region;
+        if(ra.height != rb.height) return ra.height > rb.height;
+        if(ra.width != rb.width) return ra.width > rb.width;
+        return a.first < b.first;
+    });
+
+    std::vector<std::vector<Shelf>> old_shelves(layers);
+    std::swap(old_shelves, shelves);
+    std::size_t old_used_area = used_area;
+    used_area = 0;
+
+    struct Placement{
+        GLint layer;
+        std::size_t shelf;
+        GLsizei x, y;
+    };
+
+    std::vector<Placement> placements(order.size());
+    for(std::size_t i = 0; i < order.size(); i++){
+        const Region &region = order[i].second->region;
+        Placement &p = placements[i];
+        if(!place(region.width + 2 * gutter, region.height + 2 * gutter, p.layer, p.shelf, p.x, p.y)){
+            std::swap(old_shelves, shelves);
+            used_area = old_used_area;
+            return;
+        }
+    }
+
+    for(std::size_t i = 0; i < order.size(); i++){
+        Entry &entry = *order[i].second;
+        const Placement &p = placements[i];
+        bool moved = entry.region.layer != p.layer || entry.region.x != p.x + gutter || entry.region.y != p.y + gutter;
+
+        locate(entry, p.layer, p.shelf, p.x, p.y);
+        if(moved){
+            upload(entry);
+        }
+    }
+}
+
+GLuint ShapeAtlas::texture() const noexcept{
+    return _texture;
+}
+
+GLsizei ShapeAtlas::get_size() const noexcept{
+    return size;
+}
+
+GLsizei ShapeAtlas::get_layers() const noexcept{
+    return layers;
+}
+
+std::size_t ShapeAtlas::get_count() const noexcept{
+    return entries.size();
+}
+
+//prefers the shelf wasting the least height, unless opening a new shelf wastes less
+bool ShapeAtlas::place(GLsizei width, GLsizei height, GLint &layer, std::size_t &shelf, GLsizei &x, GLsizei &y) noexcept{
+    Shelf *best = nullptr;
+    for(GLint l = 0; l < layers; l++){
+        for(std::size_t i = 0; i < shelves[l].size(); i++){
+            Shelf &s = shelves[l][i];
+            if(height > s.height || s.x + width > size) continue;
+
+            if(!best || s.height < best->height){
+                best = &s;
+                layer = l;
+                shelf = i;
+            }
+        }
+    }
+
+    if(!best || best->height - height > height / 2){
+        for(GLint l = 0; l < layers; l++){
+            GLsizei top = shelves[l].empty() ? 0 : shelves[l].back().y + shelves[l].back().height;
+            if(top + height > size) continue;
+
+            shelves[l].push_back(Shelf{top, height, 0, 0});
+            best = &shelves[l].back();
+            layer = l;
+            shelf = shelves[l].size() - 1;
+            break;
+        }
+    }
+
+    if(!best) return false;
+
+    x = best->x;
+    y = best->y;
+    best->x += width;
+    best->count++;
+    used_area += (std::size_t)width * height;
+    return true;
+}
+
+void ShapeAtlas::release(const Entry &entry) noexcept{
+    const Region &region = entry.region;
+    std::vector<Shelf> &layer = shelves[region.layer];
+    Shelf &shelf = layer[entry.shelf];
+
+    GLsizei width = region.width + 2 * gutter;
+    GLsizei height = region.height + 2 * gutter;
+    if(region.x - gutter + width == shelf.x){
+        shelf.x = region.x - gutter;
+    }
+    if(--shelf.count == 0){
+        shelf.x = 0;
+    }
+    while(!layer.empty() && layer.back().count == 0){
+        layer.pop_back();
+    }
+    used_area -= (std::size_t)width * height;
+}
+
+void ShapeAtlas::locate(Entry &entry, GLint layer, std::size_t shelf, GLsizei x, GLsizei y) noexcept{
+    Region &region = entry.region;
+    region.layer = layer;
+    region.x = x + gutter;
+    region.y = y + gutter;
+    region.width = entry.shape.get_width();
+    region.height = entry.shape.get_height();
+
+    float u0 = (float)region.x / size;
+    float v0 = (float)region.y / size;
+    float u1 = (float)(region.x + region.width) / size;
+    float v1 = (float)(region.y + region.height) / size;
+    region.uv = glm::vec4(u0, v0, u1, v1);
+
+    //the shaders compute uv = (vec4(pos.xy, 1, 1) * tex_mvp).xy * 0.5 + 0.5,
+    //so the offset goes to the w row, which stays 1 under any affine shape tex_mvp
+    region.tex_mvp = glm::mat4(1.0f);
+    region.tex_mvp[0] = glm::vec4(u1 - u0, 0.0f, 0.0f, u0 + u1 - 1.0f);
+    region.tex_mvp[1] = glm::vec4(0.0f, v1 - v0, 0.0f, v0 + v1 - 1.0f);
+
+    entry.shelf = shelf;
+}
+
+//uploads the shape with its gutter
+void ShapeAtlas::upload(const Entry &entry) const{
+    const Region &region = entry.region;
+    Shape::View shape = entry.shape.view();
+    std::size_t fragment_size = ShapeFormat::fragment_size(format);
+    std::size_t row_size = shape.width * fragment_size;
+    std::size_t padded_width = shape.width + 2 * gutter;
+    std::size_t padded_height = shape.height + 2 * gutter;
+
+    std::vector<uint8_t> staging(padded_width * padded_height * fragment_size);
+    for(std::size_t row = 0; row < shape.height; row++){
+        memcpy(&staging[((row + gutter) * padded_width + gutter) * fragment_size],
+            static_cast<const uint8_t*>(shape.fragments) + row * row_size, row_size);
+    }
+
+    GLint internal_format;
+    GLenum type;
+    Shape::Renderer::texture_format(format, internal_format, type);
+
+    GLint bound;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &bound);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, region.x - gutter, region.y - gutter, region.layer,
+        padded_width, padded_height, 1, GL_RED, type, staging.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, bound);
+}
+
+bool ShapeAtlas::evict_one() noexcept{
+    auto victim = entries.end();
+    for(auto it = entries.begin(); it != entries.end(); it++){
+        if(it->second.last_use >= frame) continue;
+
+        if(victim == entries.end() || it->second.last_use < victim->second.last_use
+        || (it->second.last_use == victim->second.last_use && it->first < victim->first)){
+            victim = it;
+        }
+    }
+
+    if(victim == entries.end()) return false;
+
+    release(victim->second);
+    entries.erase(victim);
+    return true;
+}
+
+std::size_t ShapeAtlas::free_area() const noexcept{
+    return (std::size_t)size * size * layers - used_area;
+}
+
+ShapeAtlas::Entry &ShapeAtlas::find(Handle handle){
+    auto it = entries.find(handle);
+    if(it == entries.end()){
+        throw std::invalid_argument("shape is not in the atlas");
+    }
+    return it->second;
+}
+
+const ShapeAtlas::Entry &ShapeAtlas::find(Handle handle) const{
+    auto it = entries.find(handle);
+    if(it == entries.end()){
+        throw std::invalid_argument("shape is not in the atlas");
+    }
+    return it->second;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <unordered_map>
+#include "Shape.hpp"
+#include "QuantizedShape.hpp"
+
+//packs many shapes into the square layers of one GL_TEXTURE_2D_ARRAY, for batched rendering
+//(see Shape::Renderer::begin), needs a current gl context for its whole lifetime
+//
+//shapes are packed on shelves, a gutter of zero fragments around every shape keeps linear filtering
+//from reading its neighbours, so uv up to gutter texels outside the shape sample like the border of its own texture
+//the atlas keeps a copy of every shape to repack them on compaction
+class ShapeAtlas final{
+public:
+    typedef std::uint64_t Handle;
+
+    //where a shape lives in the atlas
+    struct Region{
+        GLint layer;
+        //texels of the shape, gutter excluded
+        GLsizei x;
+        GLsizei y;
+        GLsizei width;
+        GLsizei height;
+        //u0, v0, u1, v1
+        glm::vec4 uv;
+        //maps the uv space of the shape to the region, use as tex_mvp
+        glm::mat4 tex_mvp;
+
+        //tex_mvp for a shape drawn with its own tex_mvp
+        glm::mat4 transform(const glm::mat4 &shape_tex_mvp) const noexcept{
+            return shape_tex_mvp * tex_mvp;
+        }
+    };
+
+    //size x size texels per layer, shapes are stored in the format (see QuantizedShape for range)
+    //invalid_argument if sizes are not positive or the gutter leaves no room
+    ShapeAtlas(GLsizei size, GLsizei layers, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32, float range = 1.0f, GLsizei gutter = 1);
+    ~ShapeAtlas() noexcept;
+
+    //packs the shape, compacting and then evicting shapes not used in the current frame if there is no room
+    //invalid_argument if the shape is bigger than a layer
+    //runtime_error if the atlas is full of shapes used in the current frame
+    Handle add(const Shape::View &shape);
+    Handle add(const Shape &shape);
+
+    //invalid_argument if the handle is not (or no longer) in the atlas
+    void remove(Handle handle);
+
+    //false once removed or evicted
+    bool contains(Handle handle) const noexcept;
+
+    //invalid_argument if the handle is not (or no longer) in the atlas
+    const Region &region(Handle handle) const;
+    //region that also marks the shape as used in the current frame, so it is not evicted before next_frame
+    const Region &use(Handle handle);
+
+    //shapes not used since the previous frame become evictable
+    void next_frame() noexcept;
+
+    //repacks all shapes from the tallest, reclaiming the holes removed shapes left, regions are updated
+    //left unchanged in the rare case the shapes do not fit repacked
+    void compact();
+
+    GLuint texture() const noexcept;
+    GLsizei get_size() const noexcept;
+    GLsizei get_layers() const noexcept;
+    std::size_t get_count() const noexcept;
+private:
+    struct Shelf{
+        GLsizei y;
+        GLsizei height;
+        //first free column
+        GLsizei x;
+        std::size_t count;
+    };
+
+    struct Entry{
+        QuantizedShape shape;
+        Region region;
+        std::size_t shelf;
+        std::uint64_t last_use;
+    };
+
+    //places a padded rectangle, false if there is no room
+    bool place(GLsizei width, GLsizei height, GLint &layer, std::size_t &shelf, GLsizei &x, GLsizei &y) noexcept;
+    void release(const Entry &entry) noexcept;
+    void locate(Entry &entry, GLint layer, std::size_t shelf, GLsizei x, GLsizei y) noexcept;
+    void upload(const Entry &entry) const;
+    //true if evicted a shape not used in the current frame
+    bool evict_one() noexcept;
+    std::size_t free_area() const noexcept;
+
+    Entry &find(Handle handle);
+    const Entry &find(Handle handle) const;
+
+    GLuint _texture;
+    GLsizei size;
+    GLsizei layers;
+    GLsizei gutter;
+    ShapeFormat::Format format;
+    float range;
+
+    std::vector<std::vector<Shelf>> shelves;
+    std::unordered_map<Handle, Entry> entries;
+    std::size_t used_area;
+    Handle next_handle;
+    std::uint64_t frame;
+
+    ShapeAtlas(const ShapeAtlas &copy) noexcept = delete;
+    ShapeAtlas &operator=(const ShapeAtlas &copy) noexcept = delete;
+};
@@ -0,0 +1,304 @@
+#include "ShapeCodec.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace ShapeCodec{
+
+namespace{
+
+//integer view of the fragments of a format
+struct Coding{
+    unsigned bits;
+    uint32_t mask;
+    uint32_t sign;
+    bool is_float;
+
+    Coding(ShapeFormat::Format format) noexcept{
+        bits = 8 * ShapeFormat::fragment_size(format);
+        mask = bits == 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+        sign = 1u << (bits - 1);
+        is_float = format == ShapeFormat::FORMAT_FLOAT32 || format == ShapeFormat::FORMAT_FLOAT16;
+    }
+
+    uint32_t load(const uint8_t *fragments, std::size_t i) const noexcept{
+        switch (bits){
+        case 8:
+            return fragments[i];
+        case 16:{
+            uint16_t value;
+            memcpy(&value, fragments + 2 * i, sizeof(value));
+            return value;
+        }
+        default:{
+            uint32_t value;
+            memcpy(&value, fragments + 4 * i, sizeof(value));
+            return value;
+        }
+        }
+    }
+
+    void store(uint8_t *fragments, std::size_t i, uint32_t value) const noexcept{
+        switch (bits){
+        case 8:
+            fragments[i] = value;
+            break;
+        case 16:{
+            uint16_t narrow = value;
+            memcpy(fragments + 2 * i, &narrow, sizeof(narrow));
+            break;
+        }
+        default:
+            memcpy(fragments + 4 * i, &value, sizeof(value));
+            break;
+        }
+    }
+
+    //sign magnitude floats to integers that sort like the floats do
+    uint32_t to_code(uint32_t raw) const noexcept{
+        if(!is_float) return raw;
+        return raw & sign ? ~raw & mask : raw | sign;
+    }
+
+    uint32_t from_code(uint32_t code) const noexcept{
+        if(!is_float) return code;
+        return code & sign ? code & ~sign : ~code & mask;
+    }
+
+    uint32_t zigzag(uint32_t residual) const noexcept{
+        uint32_t negative = residual & sign ? mask : 0;
+        return ((residual << 1) ^ negative) & mask;
+    }
+
+    uint32_t unzigzag(uint32_t zigzagged) const noexcept{
+        uint32_t negative = zigzagged & 1 ? mask : 0;
+        return ((zigzagged >> 1) ^ negative) & mask;
+    }
+
+    //codes holds the block row major, i is a fragment of row r and column c
+    uint32_t predict(const uint32_t *codes, std::size_t i, std::size_t r, std::size_t c, std::size_t width) const noexcept{
+        if(r == 0) return c == 0 ? 0 : codes[i - 1];
+        if(c == 0) return codes[i - width];
+        return (codes[i - 1] + codes[i - width] - codes[i - width - 1]) & mask;
+    }
+};
+
+unsigned bit_width(uint32_t value) noexcept{
+    unsigned width = 0;
+    while(value){
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+void store_u32(uint8_t *out, uint32_t value) noexcept{
+    for(int i = 0; i < 4; i++){
+        out[i] = value >> (8 * i);
+    }
+}
+
+uint32_t load_u32(const uint8_t *in) noexcept{
+    uint32_t value = 0;
+    for(int i = 0; i < 4; i++){
+        value |= (uint32_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+//largest valid block of count fragments
+std::size_t max_block_size(std::size_t count, unsigned bits) noexcept{
+    std::size_t groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+    return groups * 2 + (count * bits + 7) / 8;
+}
+
+}
+
+std::vector<uint8_t> encode(const void *fragments, std::size_t width, std::size_t height, ShapeFormat::Format format){
+    const uint8_t *bytes = static_cast<const uint8_t*>(fragments);
+    Coding coding(format);
+
+    std::vector<uint8_t> out;
+    std::vector<uint32_t> codes(BLOCK_ROWS * width);
+    std::vector<uint32_t> residuals(BLOCK_ROWS * width);
+
+    for(std::size_t first_row = 0; first_row < height; first_row += BLOCK_ROWS){
+        std::size_t count = std::min(BLOCK_ROWS, height - first_row) * width;
+        const uint8_t *block_fragments = bytes + first_row * width * ShapeFormat::fragment_size(format);
+
+        for(std::size_t i = 0; i < count; i++){
+            codes[i] = coding.to_code(coding.load(block_fragments, i));
+            uint32_t prediction = coding.predict(codes.data(), i, i / width, i % width, width);
+            residuals[i] = coding.zigzag((codes[i] - prediction) & coding.mask);
+        }
+
+        std::size_t size_pos = out.size();
+        out.resize(out.size() + 4);
+
+        for(std::size_t group = 0; group < count; group += GROUP_SIZE){
+            std::size_t group_end = std::min(group + GROUP_SIZE, count);
+
+            uint32_t largest = 0;
+            for(std::size_t i = group; i < group_end; i++){
+                largest |= residuals[i];
+            }
+
+            unsigned bits = bit_width(largest);
+            out.push_back(bits);
+
+            uint64_t acc = 0;
+            unsigned acc_bits = 0;
+            for(std::size_t i = group; i < group_end; i++){
+                acc |= (uint64_t)residuals[i] << acc_bits;
+                acc_bits += bits;
+                while(acc_bits >= 8){
+                    out.push_back(acc);
+                    acc >>= 8;
+                    acc_bits -= 8;
+                }
+            }
+            if(acc_bits){
+                out.push_back(acc);
+            }
+        }
+
+        store_u32(&out[size_pos], out.size() - size_pos - 4);
+    }
+
+    return out;
+}
+
+void write(FILE *stream, ShapeFormat::Header header, const void *fragments, bool write_magic){
+    std::vector<uint8_t> payload = encode(fragments, header.width, header.height, header.format);
+    header.flags |= ShapeFormat::FLAG_COMPRESSED;
+    header.payload_size = payload.size();
+    ShapeFormat::write(stream, header, payload.data(), write_magic);
+}
+
+Decoder::Decoder(FILE *stream, const ShapeFormat::Header &header){
+    this->stream = stream;
+    this->header = header;
+    row = 0;
+    consumed = 0;
+    crc = 0;
+    finished = false;
+
+    if(header.flags & ShapeFormat::FLAG_COMPRESSED){
+        codes.resize(BLOCK_ROWS * header.width);
+    }
+}
+
+std::size_t Decoder::next(void *out){
+    if(row >= header.height){
+        finish();
+        return 0;
+    }
+
+    std::size_t rows = std::min<std::size_t>(BLOCK_ROWS, header.height - row);
+
+    if(header.flags & ShapeFormat::FLAG_COMPRESSED){
+        uint8_t size_bytes[4];
+        read(size_bytes, sizeof(size_bytes));
+
+        std::size_t size = load_u32(size_bytes);
+        if(size > max_block_size(rows * header.width, Coding(header.format).bits)){
+            throw std::invalid_argument("shape block is damaged");
+        }
+
+        block.resize(size);
+        read(block.data(), size);
+        decode_block(rows, out);
+    }
+    else{
+        read(out, rows * row_size());
+        ShapeFormat::swap_payload(out, rows * header.width, header.format);
+    }
+
+    row += rows;
+    if(row == header.height){
+        finish();
+    }
+
+    return rows;
+}
+
+std::size_t Decoder::get_row() const noexcept{
+    return row;
+}
+
+std::size_t Decoder::row_size() const noexcept{
+    return header.width * ShapeFormat::fragment_size(header.format);
+}
+
+void Decoder::read(void *out, std::size_t size){
+    if(size > header.payload_size - consumed){
+        throw std::invalid_argument("shape payload size mismatch");
+    }
+
+    if(fread(out, 1, size, stream) != size){
+        ShapeFormat::throw_read_error(stream);
+    }
+
+    crc = ShapeFormat::crc32c(crc, out, size);
+    consumed += size;
+}
+
+void Decoder::decode_block(std::size_t rows, void *out){
+    Coding coding(header.format);
+    std::size_t width = header.width;
+    std::size_t count = rows * width;
+    std::size_t pos = 0;
+
+    for(std::size_t group = 0; group < count; group += GROUP_SIZE){
+        std::size_t group_end = std::min(group + GROUP_SIZE, count);
+
+        if(pos >= block.size()){
+            throw std::invalid_argument("shape block is damaged");
+        }
+
+        unsigned bits = block[pos++];
+        std::size_t group_size = ((group_end - group) * bits + 7) / 8;
+        if(bits > coding.bits || group_size > block.size() - pos){
+            throw std::invalid_argument("shape block is damaged");
+        }
+
+        uint64_t acc = 0;
+        unsigned acc_bits = 0;
+        uint64_t value_mask = bits == 0 ? 0 : (~(uint64_t)0 >> (64 - bits));
+        for(std::size_t i = group; i < group_end; i++){
+            while(acc_bits < bits){
+                acc |= (uint64_t)block[pos++] << acc_bits;
+                acc_bits += 8;
+            }
+            codes[i] = acc & value_mask;
+            acc >>= bits;
+            acc_bits -= bits;
+        }
+    }
+
+    if(pos != block.size()){
+        throw std::invalid_argument("shape block is damaged");
+    }
+
+    uint8_t *fragments = static_cast<uint8_t*>(out);
+    for(std::size_t i = 0; i < count; i++){
+        uint32_t prediction = coding.predict(codes.data(), i, i / width, i % width, width);
+        codes[i] = (prediction + coding.unzigzag(codes[i])) & coding.mask;
+        coding.store(fragments, i, coding.from_code(codes[i]));
+    }
+}
+
+void Decoder::finish(){
+    if(finished) return;
+    finished = true;
+
+    if(consumed != header.payload_size){
+        throw std::invalid_argument("shape payload size mismatch");
+    }
+
+    if(crc != header.payload_crc){
+        throw std::invalid_argument("shape checksum mismatch");
+    }
+}
+
+}
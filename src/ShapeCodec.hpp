@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "ShapeFormat.hpp"
+
+//compressed payload of v2 shapes (ShapeFormat::FLAG_COMPRESSED)
+//
+//rows are coded in independent blocks of BLOCK_ROWS rows (fewer in the last one), each block is
+//    u32 size of the rest of the block, little endian
+//    groups of GROUP_SIZE residuals (fewer in the last one), each group is
+//        u8 bit width of its largest residual
+//        the residuals bit packed lsb first, padded to a whole byte
+//
+//float fragments are mapped to order preserving integers, snorm ones are taken as they are,
+//each one is predicted from its neighbours in the block (left + up - up left,
+//left on the first row, up on the first column) and the residual modulo the fragment width is zigzag coded
+namespace ShapeCodec{
+    static constexpr std::size_t BLOCK_ROWS = 16;
+    static constexpr std::size_t GROUP_SIZE = 32;
+
+    //fragments are in host byte order
+    std::vector<uint8_t> encode(const void *fragments, std::size_t width, std::size_t height, ShapeFormat::Format format);
+
+    //compresses the fragments of the header shape and writes it as ShapeFormat::write does
+    void write(FILE *stream, ShapeFormat::Header header, const void *fragments, bool write_magic);
+
+    //reads a payload block by block, raw payloads are read in blocks of BLOCK_ROWS rows too,
+    //so only one compressed block is held at a time
+    class Decoder final{
+    public:
+        //stream must be positioned at the payload of header
+        Decoder(FILE *stream, const ShapeFormat::Header &header);
+
+        //decodes the next block into out, which holds BLOCK_ROWS rows, in host byte order and returns its rows
+        //returns 0 when all rows are decoded, the payload crc is checked after the last block
+        //runtime_error on stream errors, invalid_argument if the payload is damaged
+        std::size_t next(void *out);
+
+        //first row the next block starts at
+        std::size_t get_row() const noexcept;
+        std::size_t row_size() const noexcept;
+    private:
+        void read(void *out, std::size_t size);
+        void decode_block(std::size_t rows, void *out);
+        void finish();
+
+        FILE *stream;
+        ShapeFormat::Header header;
+        std::size_t row;
+        uint64_t consumed;
+        uint32_t crc;
+        bool finished;
+        std::vector<uint8_t> block;
+        std::vector<uint32_t> codes;
+    };
+}
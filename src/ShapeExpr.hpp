@@ -0,0 +1,420 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "Shape.hpp"
+#include "ShapeKernel.hpp"
+#include "ShapeFormat.hpp"
+
+//lazy csg: primitives and combinators build an expression tree whose type is known at compile time,
+//bake evaluates the whole tree into a Shape in one pass over its fragments, with no intermediate fields
+//
+//    using namespace ShapeExpr;
+//    auto face = unite(circle({0.0f, 0.0f}, 0.6f) - (circle({-0.25f, 0.2f}, 0.12f) | circle({0.25f, 0.2f}, 0.12f)),
+//        circle({0.0f, -0.7f}, 0.3f), 0.1f);
+//    bake(offset(face, -0.02f), shape);
+//
+//results are bit identical to the same Shape operations done one by one (unite, intersect, subtract, offset),
+//fragments are evaluated TILE_SIZE at a time with the ShapeKernel loops, and per tile every node bounds its values:
+//where the bounds prove one operand of a combinator wins over the whole tile the other one is not evaluated
+namespace ShapeExpr{
+    //columns of the tiles bounds are computed for, rows are the tile rows of Shape::fill
+    constexpr std::size_t TILE_SIZE = 32;
+
+    //values a node can take over a tile, lo <= hi
+    struct Interval{
+        float lo;
+        float hi;
+    };
+
+    //gl space bounding box of the fragment coordinates of a tile
+    struct Box{
+        float x0;
+        float y0;
+        float x1;
+        float y1;
+    };
+
+    //what the nodes of a tree share while one tile is planned and evaluated
+    struct Tile{
+        Box box;
+        //size of the baked shape
+        std::size_t width;
+        std::size_t height;
+        //room for index_capacity() circle indices, the first used of them hold circles not culled for the tile
+        std::uint32_t *indices;
+        std::size_t used;
+    };
+
+    //a is above b by more than k over the whole tile, padded so float rounding never culls an operand
+    //the exact comparison would keep (false for infinite or nan bounds that could be equal)
+    inline bool above(const Interval &a, const Interval &b, float k) noexcept{
+        return b.hi + k + 1e-4f * (1.0f + fabsf(a.lo) + fabsf(b.hi)) < a.lo;
+    }
+
+    inline Interval circle_interval(const Box &box, const Shape::Circle &circle) noexcept{
+        float near_x = std::max({box.x0 - circle.pos.x, 0.0f, circle.pos.x - box.x1});
+        float near_y = std::max({box.y0 - circle.pos.y, 0.0f, circle.pos.y - box.y1});
+        float far_x = std::max(fabsf(box.x0 - circle.pos.x), fabsf(box.x1 - circle.pos.x));
+        float far_y = std::max(fabsf(box.y0 - circle.pos.y), fabsf(box.y1 - circle.pos.y));
+
+        return {
+            circle.radius - sqrtf(far_x * far_x + far_y * far_y),
+            circle.radius - sqrtf(near_x * near_x + near_y * near_y),
+        };
+    }
+
+    //base of every node, nodes provide:
+    //    SLOTS, the per tile state of the subtree, TEMPS, the scratch rows its evaluation needs
+    //    std::size_t index_capacity() the tile.indices entries the subtree can take per tile
+    //    bool fits(target) whether it can be baked into the target shape
+    //    Interval plan(tile, slots) bounds over the tile, deciding what eval skips there, never allocates
+    //    void eval(tile, slots, y, x0, x1, row, scratch) row[x] for x in [x0, x1) of row y,
+    //        scratch is TEMPS rows of tile.width fragments
+    template<typename Derived>
+    struct Node{
+        //see ShapeExpr::bake
+        void bake(Shape &shape) const;
+    };
+
+    template<typename T>
+    using IsNode = std::is_base_of<Node<std::decay_t<T>>, std::decay_t<T>>;
+
+    struct CircleNode final: Node<CircleNode>{
+        static constexpr std::size_t SLOTS = 0;
+        static constexpr std::size_t TEMPS = 0;
+
+        Shape::Circle circle;
+
+        explicit CircleNode(const Shape::Circle &circle) noexcept: circle(circle){}
+
+        std::size_t index_capacity() const noexcept{
+            return 0;
+        }
+
+        bool fits(const Shape::View &) const noexcept{
+            return true;
+        }
+
+        Interval plan(Tile &tile, std::uint32_t *) const noexcept{
+            return circle_interval(tile.box, circle);
+        }
+
+        //circle_span over -INFINITY, the values Shape::unite(Circle) combines
+        void eval(const Tile &tile, const std::uint32_t *, std::size_t y, std::size_t x0, std::size_t x1, float *row, float *) const noexcept{
+            float dy = ShapeKernel::fragment_coord(y, tile.height) - circle.pos.y;
+            std::fill(row + x0, row + x1, -INFINITY);
+            ShapeKernel::circle_span(row, x0, x1, (float)tile.width, circle.pos.x, dy * dy, circle.radius);
+        }
+    };
+
+    //union of any number of circles, as draw_circles on a field of -INFINITY,
+    //per tile only circles that can get above the lower bound of the others are evaluated
+    struct CirclesNode final: Node<CirclesNode>{
+        static constexpr std::size_t SLOTS = 2;
+        static constexpr std::size_t TEMPS = 0;
+
+        std::vector<Shape::Circle> circles;
+
+        explicit CirclesNode(std::vector<Shape::Circle> circles) noexcept: circles(std::move(circles)){}
+
+        std::size_t index_capacity() const noexcept{
+            return circles.size();
+        }
+
+        bool fits(const Shape::View &) const noexcept{
+            return true;
+        }
+
+        //slots are the range of tile.indices the tile evaluates
+        Interval plan(Tile &tile, std::uint32_t *slots) const noexcept{
+            Interval bounds{-INFINITY, -INFINITY};
+            for(const auto &circle:circles){
+                Interval interval = circle_interval(tile.box, circle);
+                bounds.lo = std::max(bounds.lo, interval.lo);
+                bounds.hi = std::max(bounds.hi, interval.hi);
+            }
+
+            slots[0] = (std::uint32_t)tile.used;
+            for(std::size_t i = 0; i < circles.size(); i++){
+                if(!above(bounds, circle_interval(tile.box, circles[i]), 0.0f)){
+                    tile.indices[tile.used++] = (std::uint32_t)i;
+                }
+            }
+            slots[1] = (std::uint32_t)tile.used;
+            return bounds;
+        }
+
+        void eval(const Tile &tile, const std::uint32_t *slots, std::size_t y, std::size_t x0, std::size_t x1, float *row, float *) const noexcept{
+            float fy = ShapeKernel::fragment_coord(y, tile.height);
+            std::fill(row + x0, row + x1, -INFINITY);
+            for(std::uint32_t i = slots[0]; i < slots[1]; i++){
+                const Shape::Circle &circle = circles[tile.indices[i]];
+                float dy = fy - circle.pos.y;
+                ShapeKernel::circle_span(row, x0, x1, (float)tile.width, circle.pos.x, dy * dy, circle.radius);
+            }
+        }
+    };
+
+    //fragments of an existing field of any format, unbounded
+    struct FieldNode final: Node<FieldNode>{
+        static constexpr std::size_t SLOTS = 0;
+        static constexpr std::size_t TEMPS = 0;
+
+        Shape::View view;
+
+        explicit FieldNode(const Shape::View &view) noexcept: view(view){}
+
+        std::size_t index_capacity() const noexcept{
+            return 0;
+        }
+
+        //the baked shape is overwritten row by row, so it cannot be read as well
+        bool fits(const Shape::View &target) const noexcept{
+            return view.width == target.width && view.height == target.height && view.fragments != target.fragments;
+        }
+
+        Interval plan(Tile &, std::uint32_t *) const noexcept{
+            return {-INFINITY, INFINITY};
+        }
+
+        void eval(const Tile &, const std::uint32_t *, std::size_t y, std::size_t x0, std::size_t x1, float *row, float *) const noexcept{
+            std::size_t offset = (y * view.width + x0) * ShapeFormat::fragment_size(view.format);
+            ShapeKernel::dequantize(static_cast<const std::uint8_t*>(view.fragments) + offset, row + x0, x1 - x0, view.format, view.range);
+        }
+    };
+
+    //unite, intersect or subtract of the two operands, see ShapeKernel::combine
+    template<ShapeKernel::CombineOp OP, typename L, typename R>
+    struct CombineNode final: Node<CombineNode<OP, L, R>>{
+        //slots[0] is the operand evaluated over the tile, then the slots of left and right
+        static constexpr std::size_t SLOTS = 1 + L::SLOTS + R::SLOTS;
+        //left is evaluated into the row, right into the first scratch row
+        static constexpr std::size_t TEMPS = std::max(L::TEMPS, 1 + R::TEMPS);
+
+        enum Operands: std::uint32_t{
+            BOTH,
+            LEFT,
+            RIGHT,
+        };
+
+        L left;
+        R right;
+        float k;
+
+        template<typename A, typename B>
+        CombineNode(A &&left, B &&right, float k): left(std::forward<A>(left)), right(std::forward<B>(right)), k(k){
+            if(!(k >= 0.0f) || !std::isfinite(k)){
+                throw std::invalid_argument("smooth radius is negative or not finite");
+            }
+        }
+
+        std::size_t index_capacity() const noexcept{
+            return left.index_capacity() + right.index_capacity();
+        }
+
+        bool fits(const Shape::View &target) const noexcept{
+            return left.fits(target) && right.fits(target);
+        }
+
+        //an operand wins where the other is more than k below (union) or above it, then the blend term is zero
+        Interval plan(Tile &tile, std::uint32_t *slots) const noexcept{
+            Interval a = left.plan(tile, slots + 1);
+            Interval b = right.plan(tile, slots + 1 + L::SLOTS);
+            if(OP == ShapeKernel::COMBINE_SUBTRACT){
+                b = {-b.hi, -b.lo};
+            }
+
+            bool left_wins = OP == ShapeKernel::COMBINE_UNION ? above(a, b, k) : above(b, a, k);
+            bool right_wins = OP == ShapeKernel::COMBINE_UNION ? above(b, a, k) : above(a, b, k);
+            slots[0] = left_wins ? LEFT : right_wins ? RIGHT : BOTH;
+
+            if(left_wins) return a;
+            if(right_wins) return b;
+
+            //the blend term is at most k / 4
+            if(OP == ShapeKernel::COMBINE_UNION){
+                return {std::max(a.lo, b.lo), std::max(a.hi, b.hi) + k * 0.25f};
+            }
+            return {std::min(a.lo, b.lo) - k * 0.25f, std::min(a.hi, b.hi)};
+        }
+
+        void eval(const Tile &tile, const std::uint32_t *slots, std::size_t y, std::size_t x0, std::size_t x1, float *row, float *scratch) const noexcept{
+            switch (slots[0]){
+            case LEFT:
+                left.eval(tile, slots + 1, y, x0, x1, row, scratch);
+                break;
+            case RIGHT:
+                right.eval(tile, slots + 1 + L::SLOTS, y, x0, x1, row, scratch);
+                if(OP == ShapeKernel::COMBINE_SUBTRACT){
+                    for(std::size_t x = x0; x < x1; x++){
+                        row[x] = -row[x];
+                    }
+                }
+                break;
+            default:{
+                left.eval(tile, slots + 1, y, x0, x1, row, scratch);
+                right.eval(tile, slots + 1 + L::SLOTS, y, x0, x1, scratch, scratch + tile.width);
+
+                bool changed = false;
+                ShapeKernel::combine(row + x0, scratch + x0, x1 - x0, OP, k, changed);
+                break;
+            }
+            }
+        }
+    };
+
+    //operand plus distance, see Shape::offset
+    template<typename E>
+    struct OffsetNode final: Node<OffsetNode<E>>{
+        static constexpr std::size_t SLOTS = E::SLOTS;
+        static constexpr std::size_t TEMPS = E::TEMPS;
+
+        E operand;
+        float distance;
+
+        template<typename A>
+        OffsetNode(A &&operand, float distance): operand(std::forward<A>(operand)), distance(distance){
+            if(!std::isfinite(distance)){
+                throw std::invalid_argument("offset distance is not finite");
+            }
+        }
+
+        std::size_t index_capacity() const noexcept{
+            return operand.index_capacity();
+        }
+
+        bool fits(const Shape::View &target) const noexcept{
+            return operand.fits(target);
+        }
+
+        Interval plan(Tile &tile, std::uint32_t *slots) const noexcept{
+            Interval bounds = operand.plan(tile, slots);
+            return {bounds.lo + distance, bounds.hi + distance};
+        }
+
+        void eval(const Tile &tile, const std::uint32_t *slots, std::size_t y, std::size_t x0, std::size_t x1, float *row, float *scratch) const noexcept{
+            operand.eval(tile, slots, y, x0, x1, row, scratch);
+            if(distance != 0.0f){
+                ShapeKernel::add(row + x0, x1 - x0, distance);
+            }
+        }
+    };
+
+    inline CircleNode circle(glm::vec2 pos, float radius) noexcept{
+        return CircleNode(Shape::Circle{pos, radius});
+    }
+
+    inline CircleNode circle(const Shape::Circle &circle) noexcept{
+        return CircleNode(circle);
+    }
+
+    //invalid_argument if there are more circles than 32 bit indices address
+    inline CirclesNode circles(std::vector<Shape::Circle> circles){
+        if(circles.size() > UINT32_MAX){
+            throw std::invalid_argument("too many circles");
+        }
+        return CirclesNode(std::move(circles));
+    }
+
+    //the view must stay valid until the expression is baked, which cannot be into the viewed shape
+    inline FieldNode field(const Shape::View &view) noexcept{
+        return FieldNode(view);
+    }
+
+    inline FieldNode field(const Shape &shape) noexcept{
+        return FieldNode(shape.view());
+    }
+
+    //as the Shape operations, invalid_argument if k is negative or not finite
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    CombineNode<ShapeKernel::COMBINE_UNION, std::decay_t<A>, std::decay_t<B>> unite(A &&a, B &&b, float k = 0.0f){
+        return {std::forward<A>(a), std::forward<B>(b), k};
+    }
+
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    CombineNode<ShapeKernel::COMBINE_INTERSECT, std::decay_t<A>, std::decay_t<B>> intersect(A &&a, B &&b, float k = 0.0f){
+        return {std::forward<A>(a), std::forward<B>(b), k};
+    }
+
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    CombineNode<ShapeKernel::COMBINE_SUBTRACT, std::decay_t<A>, std::decay_t<B>> subtract(A &&a, B &&b, float k = 0.0f){
+        return {std::forward<A>(a), std::forward<B>(b), k};
+    }
+
+    //invalid_argument if distance is not finite
+    template<typename A, std::enable_if_t<IsNode<A>::value, int> = 0>
+    OffsetNode<std::decay_t<A>> offset(A &&a, float distance){
+        return {std::forward<A>(a), distance};
+    }
+
+    //sharp unite, intersect and subtract
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    auto operator|(A &&a, B &&b){
+        return unite(std::forward<A>(a), std::forward<B>(b));
+    }
+
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    auto operator&(A &&a, B &&b){
+        return intersect(std::forward<A>(a), std::forward<B>(b));
+    }
+
+    template<typename A, typename B, std::enable_if_t<IsNode<A>::value && IsNode<B>::value, int> = 0>
+    auto operator-(A &&a, B &&b){
+        return subtract(std::forward<A>(a), std::forward<B>(b));
+    }
+
+    //replaces the fragments of shape with the expression through Shape::fill (on its thread pool if set),
+    //tile by tile: the tree is planned for the tile, then evaluated span by span into the shape rows
+    //scratch rows and circle indices of every band are allocated before, allocation failures throw bad_alloc
+    //invalid_argument if a field of the expression differs in size from the shape or is the shape itself
+    template<typename E>
+    void bake(const E &expr, Shape &shape){
+        static_assert(IsNode<E>::value, "not a ShapeExpr node");
+
+        if(!expr.fits(shape.view())){
+            throw std::invalid_argument("expression field differs in size from the shape or is the shape");
+        }
+
+        std::size_t width = shape.get_width();
+        std::size_t height = shape.get_height();
+        std::size_t band_scratch = E::TEMPS * width;
+        std::size_t band_indices = expr.index_capacity();
+        if(band_indices > UINT32_MAX){
+            throw std::invalid_argument("too many circles");
+        }
+        std::vector<float> scratch(shape.band_count() * band_scratch);
+        std::vector<std::uint32_t> indices(shape.band_count() * band_indices);
+
+        shape.fill([&](std::size_t band, const Shape::Rect &rows, float *fragments){
+            std::array<std::uint32_t, E::SLOTS> slots{};
+            Tile tile{Box{}, width, height, indices.data() + band * band_indices, 0};
+
+            std::size_t y_end = rows.y + rows.height;
+            for(std::size_t x0 = 0; x0 < width; x0 += TILE_SIZE){
+                std::size_t x1 = std::min(x0 + TILE_SIZE, width);
+                tile.box = Box{
+                    ShapeKernel::fragment_coord(x0, width), ShapeKernel::fragment_coord(rows.y, height),
+                    ShapeKernel::fragment_coord(x1 - 1, width), ShapeKernel::fragment_coord(y_end - 1, height),
+                };
+
+                tile.used = 0;
+                expr.plan(tile, slots.data());
+                for(std::size_t y = rows.y; y < y_end; y++){
+                    expr.eval(tile, slots.data(), y, x0, x1, fragments + y * width, scratch.data() + band * band_scratch);
+                }
+            }
+        });
+    }
+
+    template<typename Derived>
+    void Node<Derived>::bake(Shape &shape) const{
+        ShapeExpr::bake(static_cast<const Derived&>(*this), shape);
+    }
+}
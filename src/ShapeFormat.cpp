@@ -0,0 +1,303 @@
+#include "ShapeFormat.hpp"
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHAPE_FORMAT_X86
+#include <immintrin.h>
+#endif
+
+namespace ShapeFormat{
+
+namespace{
+
+void store_u32(uint8_t *out, uint32_t value) noexcept{
+    for(int i = 0; i < 4; i++){
+        out[i] = value >> (8 * i);
+    }
+}
+
+void store_u64(uint8_t *out, uint64_t value) noexcept{
+    for(int i = 0; i < 8; i++){
+        out[i] = value >> (8 * i);
+    }
+}
+
+uint32_t load_u32(const uint8_t *in) noexcept{
+    uint32_t value = 0;
+    for(int i = 0; i < 4; i++){
+        value |= (uint32_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+uint64_t load_u64(const uint8_t *in) noexcept{
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++){
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+struct CrcTable{
+    uint32_t entries[256];
+
+    CrcTable() noexcept{
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; bit++){
+                crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t *data, std::size_t size) noexcept{
+    static const CrcTable table;
+
+    for(std::size_t i = 0; i < size; i++){
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef SHAPE_FORMAT_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, std::size_t size) noexcept{
+    uint64_t crc64 = crc;
+
+    std::size_t i = 0;
+    for(; i + 8 <= size; i += 8){
+        uint64_t chunk;
+        memcpy(&chunk, data + i, sizeof(chunk));
+        crc64 = _mm_crc32_u64(crc64, chunk);
+    }
+
+    crc = (uint32_t)crc64;
+    for(; i < size; i++){
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+    return crc;
+}
+
+bool has_sse42() noexcept{
+    static const bool result = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+    return result;
+}
+#endif
+
+}
+
+Header header_for(std::size_t width, std::size_t height, Format format, float range){
+    if(width > UINT32_MAX || height > UINT32_MAX){
+        throw std::invalid_argument("shape is too large for the format");
+    }
+
+    if(fragment_size(format) == 0){
+        throw std::invalid_argument("unsupported shape format");
+    }
+
+    if(is_normalized(format) && !(range > 0.0f && range < INFINITY)){
+        throw std::invalid_argument("normalized shape range must be positive and finite");
+    }
+
+    Header header{};
+    header.width = width;
+    header.height = height;
+    header.format = format;
+    header.flags = 0;
+    header.payload_offset = (HEADER_SIZE + PAYLOAD_ALIGNMENT - 1) / PAYLOAD_ALIGNMENT * PAYLOAD_ALIGNMENT;
+    header.payload_size = (uint64_t)width * height * fragment_size(format);
+    header.payload_crc = 0;
+    header.range = range;
+    return header;
+}
+
+void encode(const Header &header, uint8_t *out) noexcept{
+    memset(out, 0, HEADER_SIZE);
+    memcpy(out, MAGIC.data(), MAGIC.size());
+    store_u32(out + 8, VERSION);
+    store_u32(out + 12, HEADER_SIZE);
+    store_u32(out + 16, header.width);
+    store_u32(out + 20, header.height);
+    store_u32(out + 24, header.format);
+    store_u32(out + 28, header.flags);
+    store_u64(out + 32, header.payload_offset);
+    store_u64(out + 40, header.payload_size);
+    store_u32(out + 48, header.payload_crc);
+
+    uint32_t range;
+    memcpy(&range, &header.range, sizeof(range));
+    store_u32(out + 56, range);
+    store_u32(out + 60, crc32c(0, out, 60));
+}
+
+Header decode(const uint8_t *in){
+    if(memcmp(in, MAGIC.data(), MAGIC.size()) != 0){
+        throw std::invalid_argument("shape magic mismatch");
+    }
+
+    if(load_u32(in + 60) != crc32c(0, in, 60)){
+        throw std::invalid_argument("shape header checksum mismatch");
+    }
+
+    if(load_u32(in + 52) != 0){
+        throw std::invalid_argument("shape header reserved bytes are not zero");
+    }
+
+    if(load_u32(in + 8) != VERSION || load_u32(in + 12) != HEADER_SIZE){
+        throw std::invalid_argument("unsupported shape version");
+    }
+
+    Header header{};
+    header.width = load_u32(in + 16);
+    header.height = load_u32(in + 20);
+    header.format = (Format)load_u32(in + 24);
+    header.flags = load_u32(in + 28);
+    header.payload_offset = load_u64(in + 32);
+    header.payload_size = load_u64(in + 40);
+    header.payload_crc = load_u32(in + 48);
+
+    uint32_t range = load_u32(in + 56);
+    memcpy(&header.range, &range, sizeof(range));
+
+    if(fragment_size(header.format) == 0 || (header.flags & ~FLAG_COMPRESSED) != 0
+    || (is_normalized(header.format) && !(header.range > 0.0f && header.range < INFINITY))){
+        throw std::invalid_argument("unsupported shape format");
+    }
+
+    if((uint64_t)header.width * header.height > UINT64_MAX / 16){
+        throw std::invalid_argument("shape header is inconsistent");
+    }
+
+    if(header.payload_offset < HEADER_SIZE || header.payload_offset % PAYLOAD_ALIGNMENT != 0
+    || (!(header.flags & FLAG_COMPRESSED) && header.payload_size != (uint64_t)header.width * header.height * fragment_size(header.format))){
+        throw std::invalid_argument("shape header is inconsistent");
+    }
+
+    return header;
+}
+
+std::size_t fragment_size(Format format) noexcept{
+    switch (format){
+    case FORMAT_FLOAT32:
+        return 4;
+    case FORMAT_FLOAT16:
+    case FORMAT_SNORM16:
+        return 2;
+    case FORMAT_SNORM8:
+        return 1;
+    }
+    return 0;
+}
+
+bool is_normalized(Format format) noexcept{
+    return format == FORMAT_SNORM16 || format == FORMAT_SNORM8;
+}
+
+void write(FILE *stream, Header header, const void *payload, bool write_magic){
+    std::vector<uint8_t> swapped;
+    if(!host_is_little_endian() && !(header.flags & FLAG_COMPRESSED)){
+        swapped.assign(static_cast<const uint8_t*>(payload), static_cast<const uint8_t*>(payload) + header.payload_size);
+        swap_payload(swapped.data(), (std::size_t)header.width * header.height, header.format);
+        payload = swapped.data();
+    }
+    header.payload_crc = crc32c(0, payload, header.payload_size);
+
+    std::array<uint8_t, HEADER_SIZE> bytes;
+    encode(header, bytes.data());
+
+    std::size_t skip = write_magic ? 0 : MAGIC.size();
+    fwrite(bytes.data() + skip, 1, bytes.size() - skip, stream);
+
+    for(std::size_t pos = HEADER_SIZE; pos < header.payload_offset; pos++){
+        fputc(0, stream);
+    }
+
+    fwrite(payload, 1, header.payload_size, stream);
+
+    if(ferror(stream)){
+        throw std::runtime_error(strerror(errno));
+    }
+}
+
+Header read_header_without_magic(FILE *stream){
+    std::array<uint8_t, HEADER_SIZE> bytes;
+    memcpy(&bytes[0], MAGIC.data(), MAGIC.size());
+
+    std::size_t rest = bytes.size() - MAGIC.size();
+    if(fread(&bytes[MAGIC.size()], 1, rest, stream) != rest){
+        throw_read_error(stream);
+    }
+
+    Header header = decode(bytes.data());
+
+    for(std::size_t pos = HEADER_SIZE; pos < header.payload_offset; pos++){
+        if(fgetc(stream) == EOF){
+            throw_read_error(stream);
+        }
+    }
+
+    return header;
+}
+
+void read_payload(FILE *stream, const Header &header, void *payload){
+    if(fread(payload, 1, header.payload_size, stream) != header.payload_size){
+        throw_read_error(stream);
+    }
+
+    if(crc32c(0, payload, header.payload_size) != header.payload_crc){
+        throw std::invalid_argument("shape checksum mismatch");
+    }
+
+    swap_payload(payload, (std::size_t)header.width * header.height, header.format);
+}
+
+void throw_read_error(FILE *stream){
+    if(ferror(stream)){
+        throw std::runtime_error(strerror(errno));
+    }
+    else{
+        throw std::invalid_argument("shape is truncated");
+    }
+}
+
+void swap_payload(void *payload, std::size_t count, Format format) noexcept{
+    if(host_is_little_endian()) return;
+
+    uint8_t *bytes = static_cast<uint8_t*>(payload);
+    std::size_t size = fragment_size(format);
+
+    for(std::size_t i = 0; i < count; i++){
+        uint8_t *fragment = bytes + i * size;
+        for(std::size_t b = 0; b < size / 2; b++){
+            std::swap(fragment[b], fragment[size - 1 - b]);
+        }
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, std::size_t size) noexcept{
+    const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+#ifdef SHAPE_FORMAT_X86
+    if(has_sse42()){
+        return ~crc32c_sse42(~crc, bytes, size);
+    }
+#endif
+
+    return ~crc32c_scalar(~crc, bytes, size);
+}
+
+bool host_is_little_endian() noexcept{
+    const uint16_t probe = 1;
+    uint8_t first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+}
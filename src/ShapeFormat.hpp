@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+//.shape file layout
+//
+//v1 ("SHAPE \n\0"): magic, u64 width, u64 height, width * height host floats
+//
+//v2 ("SHAPE2\n\0"): magic, then little endian fields at offsets
+//     8  u32 version           VERSION
+//    12  u32 header_size       HEADER_SIZE
+//    16  u32 width
+//    20  u32 height
+//    24  u32 format            Format
+//    28  u32 flags             Flags
+//    32  u64 payload_offset    multiple of PAYLOAD_ALIGNMENT, counted from the magic
+//    40  u64 payload_size      in bytes, width * height * fragment size unless compressed
+//    48  u32 payload_crc       crc32c of the payload
+//    52  u32 reserved          zero
+//    56  f32 range             distance stored as +-1 by normalized formats
+//    60  u32 header_crc        crc32c of bytes [0, 60)
+//  then zeros up to payload_offset and the payload
+//
+//streams written without magic start at offset 8, offsets still count the magic
+namespace ShapeFormat{
+    static constexpr std::array<char, 8> MAGIC_V1{'S', 'H', 'A', 'P', 'E', ' ', '\n', '\0'};
+    static constexpr std::array<char, 8> MAGIC{'S', 'H', 'A', 'P', 'E', '2', '\n', '\0'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr std::size_t HEADER_SIZE = 64;
+    static constexpr std::size_t PAYLOAD_ALIGNMENT = 64;
+
+    enum Format: uint32_t{
+        //little endian ieee754 binary32 per fragment
+        FORMAT_FLOAT32 = 0,
+        //little endian ieee754 binary16 per fragment
+        FORMAT_FLOAT16 = 1,
+        //little endian int16, fragment / range clamped to [-1, 1] and scaled by 32767
+        FORMAT_SNORM16 = 2,
+        //int8, fragment / range clamped to [-1, 1] and scaled by 127
+        FORMAT_SNORM8 = 3,
+    };
+
+    enum Flags: uint32_t{
+        //payload is a sequence of ShapeCodec blocks instead of raw fragments
+        FLAG_COMPRESSED = 1,
+    };
+
+    struct Header{
+        uint32_t width;
+        uint32_t height;
+        Format format;
+        uint32_t flags;
+        uint64_t payload_offset;
+        uint64_t payload_size;
+        uint32_t payload_crc;
+        float range;
+    };
+
+    //payload offset and size for a shape, crc is left 0
+    //invalid_argument if the shape does not fit the format
+    Header header_for(std::size_t width, std::size_t height, Format format, float range = 1.0f);
+
+    //writes HEADER_SIZE bytes, magic included
+    void encode(const Header &header, uint8_t *out) noexcept;
+
+    //in is HEADER_SIZE bytes, magic included
+    //invalid_argument if the header is damaged or not supported
+    Header decode(const uint8_t *in);
+
+    std::size_t fragment_size(Format format) noexcept;
+    bool is_normalized(Format format) noexcept;
+
+    //fills the payload crc and writes header, padding and the payload
+    //raw payloads are given in host byte order and written little endian
+    //runtime_error on stream errors
+    void write(FILE *stream, Header header, const void *payload, bool write_magic);
+
+    //reads the header of a stream positioned after the magic and skips to the payload
+    //runtime_error on stream errors, invalid_argument if the header is damaged or not supported
+    Header read_header_without_magic(FILE *stream);
+
+    //reads header.payload_size bytes of a raw payload and checks them against the crc
+    //runtime_error on stream errors, invalid_argument if the payload is truncated or damaged
+    void read_payload(FILE *stream, const Header &header, void *payload);
+
+    //throws the error of the stream, or invalid_argument if it just ended
+    [[noreturn]] void throw_read_error(FILE *stream);
+
+    //converts a payload between little endian and host byte order, no op on little endian hosts
+    void swap_payload(void *payload, std::size_t count, Format format) noexcept;
+
+    uint32_t crc32c(uint32_t crc, const void *data, std::size_t size) noexcept;
+
+    bool host_is_little_endian() noexcept;
+}
@@ -0,0 +1,913 @@
+#include "ShapeKernel.hpp"
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHAPE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace ShapeKernel{
+
+namespace{
+
+typedef void (*CircleSpanFn)(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr);
+typedef float (*MinFn)(const float *data, std::size_t count);
+typedef void (*DownsampleFn)(const float *row0, const float *row1, float *out, std::size_t count);
+typedef float (*CombineFn)(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed);
+typedef void (*AddFn)(float *row, std::size_t count, float value);
+typedef void (*SampleFn)(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count);
+typedef void (*BlendFn)(float *rgba, const float *value, std::size_t count, const float color[4], float power);
+typedef void (*BlendRgba8Fn)(uint8_t *rgba, const float *value, std::size_t count, const float color[4], float power);
+typedef void (*ToHalfFn)(const float *in, uint16_t *out, std::size_t count);
+typedef void (*FromHalfFn)(const uint16_t *in, float *out, std::size_t count);
+typedef void (*ToSnorm16Fn)(const float *in, int16_t *out, std::size_t count, float range);
+typedef void (*FromSnorm16Fn)(const int16_t *in, float *out, std::size_t count, float range);
+typedef void (*ToSnorm8Fn)(const float *in, int8_t *out, std::size_t count, float range);
+typedef void (*FromSnorm8Fn)(const int8_t *in, float *out, std::size_t count, float range);
+
+struct Dispatch{
+    CircleSpanFn circle_span;
+    MinFn min;
+    DownsampleFn downsample;
+    CombineFn combine;
+    AddFn add;
+    SampleFn sample;
+    BlendFn blend;
+    BlendRgba8Fn blend_rgba8;
+    ToHalfFn to_half;
+    FromHalfFn from_half;
+    ToSnorm16Fn to_snorm16;
+    FromSnorm16Fn from_snorm16;
+    ToSnorm8Fn to_snorm8;
+    FromSnorm8Fn from_snorm8;
+    const char *isa;
+};
+
+//operation order matches the original per pixel glm code: px = 2x / w - 1, dx = px - cx, d = sqrt(dx * dx + dy * dy)
+void circle_span_scalar(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr){
+    for(std::size_t x = begin; x < end; x++){
+        float px = (float)(2 * x) / width - 1.0f;
+        float dx = px - cx;
+        float circle_dst = cr - sqrtf(dx * dx + dy2);
+
+        if(circle_dst > row[x]){
+            row[x] = circle_dst;
+        }
+    }
+}
+
+float min_scalar(const float *data, std::size_t count){
+    float result = INFINITY;
+    for(std::size_t i = 0; i < count; i++){
+        result = data[i] < result ? data[i] : result;
+    }
+    return result;
+}
+
+void downsample_scalar(const float *row0, const float *row1, float *out, std::size_t count){
+    for(std::size_t i = 0; i < count; i++){
+        out[i] = ((row0[2 * i] + row0[2 * i + 1]) + (row1[2 * i] + row1[2 * i + 1])) * 0.25f;
+    }
+}
+
+//max and min as (a > b ? a : b) and (a < b ? a : b), the comparisons _mm_max_ps and _mm_min_ps do
+float combine_scalar(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed){
+    const bool is_union = op == COMBINE_UNION;
+    const float quarter_k = k * 0.25f;
+
+    float result_min = INFINITY;
+    bool any = false;
+    for(std::size_t i = 0; i < count; i++){
+        float a = row[i];
+        float b = op == COMBINE_SUBTRACT ? -other[i] : other[i];
+        float r = is_union ? (a > b ? a : b) : (a < b ? a : b);
+
+        if(k > 0.0f){
+            float d = fabsf(a - b);
+            float h = d < k ? (k - d) / k : 0.0f;
+            float bump = h * h * quarter_k;
+            r = is_union ? r + bump : r - bump;
+        }
+
+        any = any || r != a;
+        row[i] = r;
+        result_min = r < result_min ? r : result_min;
+    }
+
+    changed = changed || any;
+    return result_min;
+}
+
+void add_scalar(float *row, std::size_t count, float value){
+    for(std::size_t i = 0; i < count; i++){
+        row[i] += value;
+    }
+}
+
+//sampled fragments clamp to +-SAMPLE_LIMIT (nan to -SAMPLE_LIMIT)
+const float SAMPLE_LIMIT = 1e30f;
+
+inline float sample_fragment(const float *field, long width, long height, long x, long y){
+    if(x < 0 || y < 0 || x >= width || y >= height) return 0.0f;
+
+    float f = field[y * width + x];
+    f = f > -SAMPLE_LIMIT ? f : -SAMPLE_LIMIT;
+    return f < SAMPLE_LIMIT ? f : SAMPLE_LIMIT;
+}
+
+//clamping coordinates to [-2, size + 1] keeps them integer convertible, both taps still read the border out there
+inline float sample_clamp(float c, float limit){
+    c = c > -2.0f ? c : -2.0f;
+    return c < limit ? c : limit;
+}
+
+void sample_scalar(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count){
+    const long w = (long)width;
+    const long h = (long)height;
+    const float max_u = (float)width + 1.0f;
+    const float max_v = (float)height + 1.0f;
+
+    for(std::size_t i = 0; i < count; i++){
+        float fu = sample_clamp(u[i], max_u);
+        float fv = sample_clamp(v[i], max_v);
+        float x0 = floorf(fu);
+        float y0 = floorf(fv);
+        float a = fu - x0;
+        float b = fv - y0;
+        long x = (long)x0;
+        long y = (long)y0;
+
+        float r0 = sample_fragment(field, w, h, x, y) * (1.0f - a) + sample_fragment(field, w, h, x + 1, y) * a;
+        float r1 = sample_fragment(field, w, h, x, y + 1) * (1.0f - a) + sample_fragment(field, w, h, x + 1, y + 1) * a;
+        out[i] = r0 * (1.0f - b) + r1 * b;
+    }
+}
+
+inline float blend_alpha(float value, float power, float opacity){
+    float alpha = value * power;
+    alpha = alpha > -1.0f ? alpha : -1.0f;
+    alpha = alpha < 1.0f ? alpha : 1.0f;
+    return alpha * opacity;
+}
+
+void blend_scalar(float *rgba, const float *value, std::size_t count, const float color[4], float power){
+    for(std::size_t i = 0; i < count; i++){
+        float alpha = blend_alpha(value[i], power, color[3]);
+        float keep = 1.0f - alpha;
+        float *pixel = rgba + 4 * i;
+
+        pixel[0] = color[0] * alpha + pixel[0] * keep;
+        pixel[1] = color[1] * alpha + pixel[1] * keep;
+        pixel[2] = color[2] * alpha + pixel[2] * keep;
+        pixel[3] = alpha * alpha + pixel[3] * keep;
+    }
+}
+
+inline float unorm_clamp(float f){
+    f = f > 0.0f ? f : 0.0f;
+    return f < 1.0f ? f : 1.0f;
+}
+
+void blend_rgba8_scalar(uint8_t *rgba, const float *value, std::size_t count, const float color[4], float power){
+    const float src[3] = {unorm_clamp(color[0]), unorm_clamp(color[1]), unorm_clamp(color[2])};
+
+    for(std::size_t i = 0; i < count; i++){
+        float alpha = unorm_clamp(blend_alpha(value[i], power, color[3]));
+        float keep = 1.0f - alpha;
+        uint8_t *pixel = rgba + 4 * i;
+
+        for(int c = 0; c < 4; c++){
+            float dst = (float)pixel[c] * (1.0f / 255.0f);
+            float result = (c < 3 ? src[c] : alpha) * alpha + dst * keep;
+            pixel[c] = (uint8_t)(int)(result * 255.0f + 0.5f);
+        }
+    }
+}
+
+//round to nearest even, nan keeps the top of its payload and becomes quiet, same as f16c
+void to_half_scalar(const float *in, uint16_t *out, std::size_t count){
+    for(std::size_t i = 0; i < count; i++){
+        uint32_t bits;
+        memcpy(&bits, &in[i], sizeof(bits));
+
+        uint16_t sign = (bits >> 16) & 0x8000;
+        uint32_t abs = bits & 0x7FFFFFFF;
+
+        if(abs >= 0x7F800000){
+            out[i] = sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 | ((abs >> 13) & 0x3FF) : 0);
+        }
+        else if(abs >= 0x477FF000){
+            out[i] = sign | 0x7C00;
+        }
+        else if(abs < 0x38800000){
+            //adding 0.5 rounds to a multiple of 2^-24, the half subnormal step
+            float magnitude;
+            memcpy(&magnitude, &abs, sizeof(magnitude));
+            magnitude += 0.5f;
+
+            uint32_t rounded;
+            memcpy(&rounded, &magnitude, sizeof(rounded));
+            out[i] = sign | (rounded - 0x3F000000);
+        }
+        else{
+            uint32_t odd = (abs >> 13) & 1;
+            out[i] = sign | ((abs + 0xC8000FFF + odd) >> 13);
+        }
+    }
+}
+
+void from_half_scalar(const uint16_t *in, float *out, std::size_t count){
+    for(std::size_t i = 0; i < count; i++){
+        uint32_t sign = (uint32_t)(in[i] & 0x8000) << 16;
+        uint32_t exponent = (in[i] >> 10) & 0x1F;
+        uint32_t mantissa = in[i] & 0x3FF;
+
+        uint32_t bits;
+        if(exponent == 0){
+            float magnitude = mantissa * (1.0f / 16777216.0f);
+            memcpy(&bits, &magnitude, sizeof(bits));
+            bits |= sign;
+        }
+        else if(exponent == 0x1F){
+            bits = sign | 0x7F800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+        }
+        else{
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        memcpy(&out[i], &bits, sizeof(bits));
+    }
+}
+
+template<typename T, int SCALE>
+void to_snorm_scalar(const float *in, T *out, std::size_t count, float range){
+    for(std::size_t i = 0; i < count; i++){
+        float f = in[i] / range;
+        f = f > -1.0f ? f : -1.0f;
+        f = f < 1.0f ? f : 1.0f;
+        out[i] = (T)lrintf(f * (float)SCALE);
+    }
+}
+
+template<typename T, int SCALE>
+void from_snorm_scalar(const T *in, float *out, std::size_t count, float range){
+    for(std::size_t i = 0; i < count; i++){
+        float f = (float)in[i] / (float)SCALE;
+        f = f > -1.0f ? f : -1.0f;
+        out[i] = f * range;
+    }
+}
+
+#ifdef SHAPE_KERNEL_X86
+
+//clamped and scaled like to_snorm_scalar, _mm_cvtps_epi32 rounds to nearest even as lrintf does
+inline __m128i to_snorm_sse2(__m128 in, __m128 range, __m128 scale){
+    __m128 f = _mm_div_ps(in, range);
+    f = _mm_max_ps(f, _mm_set1_ps(-1.0f));
+    f = _mm_min_ps(f, _mm_set1_ps(1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(f, scale));
+}
+
+inline __m128 from_snorm_sse2(__m128i in, __m128 range, __m128 scale){
+    __m128 f = _mm_div_ps(_mm_cvtepi32_ps(in), scale);
+    f = _mm_max_ps(f, _mm_set1_ps(-1.0f));
+    return _mm_mul_ps(f, range);
+}
+
+void to_snorm16_sse2(const float *in, int16_t *out, std::size_t count, float range){
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i lo = to_snorm_sse2(_mm_loadu_ps(in + i), vrange, scale);
+        __m128i hi = to_snorm_sse2(_mm_loadu_ps(in + i + 4), vrange, scale);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+
+    to_snorm_scalar<int16_t, 32767>(in + i, out + i, count - i, range);
+}
+
+void from_snorm16_sse2(const int16_t *in, float *out, std::size_t count, float range){
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, from_snorm_sse2(lo, vrange, scale));
+        _mm_storeu_ps(out + i + 4, from_snorm_sse2(hi, vrange, scale));
+    }
+
+    from_snorm_scalar<int16_t, 32767>(in + i, out + i, count - i, range);
+}
+
+void to_snorm8_sse2(const float *in, int8_t *out, std::size_t count, float range){
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 scale = _mm_set1_ps(127.0f);
+
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i a = to_snorm_sse2(_mm_loadu_ps(in + i), vrange, scale);
+        __m128i b = to_snorm_sse2(_mm_loadu_ps(in + i + 4), vrange, scale);
+        __m128i c = to_snorm_sse2(_mm_loadu_ps(in + i + 8), vrange, scale);
+        __m128i d = to_snorm_sse2(_mm_loadu_ps(in + i + 12), vrange, scale);
+        __m128i packed = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+
+    to_snorm_scalar<int8_t, 127>(in + i, out + i, count - i, range);
+}
+
+void from_snorm8_sse2(const int8_t *in, float *out, std::size_t count, float range){
+    const __m128 vrange = _mm_set1_ps(range);
+    const __m128 scale = _mm_set1_ps(127.0f);
+
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo16 = _mm_unpacklo_epi8(v, v);
+        __m128i hi16 = _mm_unpackhi_epi8(v, v);
+        __m128i parts[4] = {
+            _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 24),
+            _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 24),
+            _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 24),
+            _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 24),
+        };
+
+        for(int p = 0; p < 4; p++){
+            _mm_storeu_ps(out + i + 4 * p, from_snorm_sse2(parts[p], vrange, scale));
+        }
+    }
+
+    from_snorm_scalar<int8_t, 127>(in + i, out + i, count - i, range);
+}
+
+//exact for the clamped sample coordinates
+inline __m128 floor_sse2(__m128 x){
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+//coordinates, weights and filtering are vectorized, the taps are fetched one fragment at a time
+void sample_sse2(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count){
+    const long w = (long)width;
+    const long h = (long)height;
+    const __m128 min_c = _mm_set1_ps(-2.0f);
+    const __m128 max_u = _mm_set1_ps((float)width + 1.0f);
+    const __m128 max_v = _mm_set1_ps((float)height + 1.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 fu = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(u + i), min_c), max_u);
+        __m128 fv = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(v + i), min_c), max_v);
+        __m128 x0 = floor_sse2(fu);
+        __m128 y0 = floor_sse2(fv);
+        __m128 a = _mm_sub_ps(fu, x0);
+        __m128 b = _mm_sub_ps(fv, y0);
+
+        alignas(16) int32_t xs[4];
+        alignas(16) int32_t ys[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(xs), _mm_cvttps_epi32(x0));
+        _mm_store_si128(reinterpret_cast<__m128i*>(ys), _mm_cvttps_epi32(y0));
+
+        alignas(16) float taps[4][4];
+        for(int k = 0; k < 4; k++){
+            taps[0][k] = sample_fragment(field, w, h, xs[k], ys[k]);
+            taps[1][k] = sample_fragment(field, w, h, xs[k] + 1, ys[k]);
+            taps[2][k] = sample_fragment(field, w, h, xs[k], ys[k] + 1);
+            taps[3][k] = sample_fragment(field, w, h, xs[k] + 1, ys[k] + 1);
+        }
+
+        __m128 ia = _mm_sub_ps(one, a);
+        __m128 r0 = _mm_add_ps(_mm_mul_ps(_mm_load_ps(taps[0]), ia), _mm_mul_ps(_mm_load_ps(taps[1]), a));
+        __m128 r1 = _mm_add_ps(_mm_mul_ps(_mm_load_ps(taps[2]), ia), _mm_mul_ps(_mm_load_ps(taps[3]), a));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(r0, _mm_sub_ps(one, b)), _mm_mul_ps(r1, b)));
+    }
+
+    sample_scalar(field, width, height, u + i, v + i, out + i, count - i);
+}
+
+inline __m128 blend_alpha_sse2(__m128 value, __m128 power, __m128 opacity){
+    __m128 alpha = _mm_mul_ps(value, power);
+    alpha = _mm_max_ps(alpha, _mm_set1_ps(-1.0f));
+    alpha = _mm_min_ps(alpha, _mm_set1_ps(1.0f));
+    return _mm_mul_ps(alpha, opacity);
+}
+
+//alpha is computed for four pixels at once, each pixel is then blended as one vector of its channels
+void blend_sse2(float *rgba, const float *value, std::size_t count, const float color[4], float power){
+    const __m128 vpower = _mm_set1_ps(power);
+    const __m128 opacity = _mm_set1_ps(color[3]);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 alpha = blend_alpha_sse2(_mm_loadu_ps(value + i), vpower, opacity);
+
+        alignas(16) float alphas[4];
+        alignas(16) float keeps[4];
+        _mm_store_ps(alphas, alpha);
+        _mm_store_ps(keeps, _mm_sub_ps(one, alpha));
+
+        for(int k = 0; k < 4; k++){
+            float *pixel = rgba + 4 * (i + k);
+            __m128 src = _mm_setr_ps(color[0], color[1], color[2], alphas[k]);
+            __m128 dst = _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(keeps[k]));
+            _mm_storeu_ps(pixel, _mm_add_ps(_mm_mul_ps(src, _mm_set1_ps(alphas[k])), dst));
+        }
+    }
+
+    blend_scalar(rgba + 4 * i, value + i, count - i, color, power);
+}
+
+void blend_rgba8_sse2(uint8_t *rgba, const float *value, std::size_t count, const float color[4], float power){
+    const __m128 vpower = _mm_set1_ps(power);
+    const __m128 opacity = _mm_set1_ps(color[3]);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 to_unit = _mm_set1_ps(1.0f / 255.0f);
+    const __m128 to_byte = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i zeroi = _mm_setzero_si128();
+    const float src_rgb[3] = {unorm_clamp(color[0]), unorm_clamp(color[1]), unorm_clamp(color[2])};
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 alpha = blend_alpha_sse2(_mm_loadu_ps(value + i), vpower, opacity);
+        alpha = _mm_min_ps(_mm_max_ps(alpha, zero), one);
+
+        alignas(16) float alphas[4];
+        alignas(16) float keeps[4];
+        _mm_store_ps(alphas, alpha);
+        _mm_store_ps(keeps, _mm_sub_ps(one, alpha));
+
+        for(int k = 0; k < 4; k++){
+            uint8_t *pixel = rgba + 4 * (i + k);
+
+            int32_t bytes;
+            memcpy(&bytes, pixel, sizeof(bytes));
+            __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zeroi), zeroi);
+
+            __m128 src = _mm_setr_ps(src_rgb[0], src_rgb[1], src_rgb[2], alphas[k]);
+            __m128 dst = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(channels), to_unit), _mm_set1_ps(keeps[k]));
+            __m128 result = _mm_add_ps(_mm_mul_ps(src, _mm_set1_ps(alphas[k])), dst);
+
+            channels = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(result, to_byte), half));
+            channels = _mm_packus_epi16(_mm_packs_epi32(channels, channels), channels);
+            bytes = _mm_cvtsi128_si32(channels);
+            memcpy(pixel, &bytes, sizeof(bytes));
+        }
+    }
+
+    blend_rgba8_scalar(rgba + 4 * i, value + i, count - i, color, power);
+}
+
+__attribute__((target("avx,f16c")))
+void to_half_f16c(const float *in, uint16_t *out, std::size_t count){
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), half);
+    }
+
+    to_half_scalar(in + i, out + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+void from_half_f16c(const uint16_t *in, float *out, std::size_t count){
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(half));
+    }
+
+    from_half_scalar(in + i, out + i, count - i);
+}
+
+//_mm_max_ps(a, b) is (a > b ? a : b), the same comparison the scalar path does
+void circle_span_sse2(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr){
+    const __m128 w = _mm_set1_ps(width);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 vcx = _mm_set1_ps(cx);
+    const __m128 vdy2 = _mm_set1_ps(dy2);
+    const __m128 vcr = _mm_set1_ps(cr);
+    const __m128i step = _mm_setr_epi32(0, 2, 4, 6);
+    const __m128i next = _mm_set1_epi32(8);
+
+    std::size_t x = begin;
+    for(; x + 8 <= end; x += 8){
+        __m128i ix0 = _mm_add_epi32(_mm_set1_epi32((int)(2 * x)), step);
+        __m128i ix1 = _mm_add_epi32(ix0, next);
+
+        __m128 dx0 = _mm_sub_ps(_mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(ix0), w), one), vcx);
+        __m128 dx1 = _mm_sub_ps(_mm_sub_ps(_mm_div_ps(_mm_cvtepi32_ps(ix1), w), one), vcx);
+        __m128 v0 = _mm_sub_ps(vcr, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx0, dx0), vdy2)));
+        __m128 v1 = _mm_sub_ps(vcr, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx1, dx1), vdy2)));
+
+        _mm_storeu_ps(row + x, _mm_max_ps(v0, _mm_loadu_ps(row + x)));
+        _mm_storeu_ps(row + x + 4, _mm_max_ps(v1, _mm_loadu_ps(row + x + 4)));
+    }
+
+    circle_span_scalar(row, x, end, width, cx, dy2, cr);
+}
+
+float min_sse2(const float *data, std::size_t count){
+    __m128 m = _mm_set1_ps(INFINITY);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        m = _mm_min_ps(_mm_loadu_ps(data + i), m);
+    }
+
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    float result = _mm_cvtss_f32(m);
+
+    for(; i < count; i++){
+        result = data[i] < result ? data[i] : result;
+    }
+    return result;
+}
+
+//even and odd columns are split by shuffles, so the additions happen in the scalar order
+void downsample_sse2(const float *row0, const float *row1, float *out, std::size_t count){
+    const __m128 quarter = _mm_set1_ps(0.25f);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 a0 = _mm_loadu_ps(row0 + 2 * i);
+        __m128 a1 = _mm_loadu_ps(row0 + 2 * i + 4);
+        __m128 b0 = _mm_loadu_ps(row1 + 2 * i);
+        __m128 b1 = _mm_loadu_ps(row1 + 2 * i + 4);
+
+        __m128 a = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128 b = _mm_add_ps(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+    }
+
+    downsample_scalar(row0 + 2 * i, row1 + 2 * i, out + i, count - i);
+}
+
+//negating b flips its sign bit like the scalar -b, nan differences never count as smaller than k
+float combine_sse2(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed){
+    const bool is_union = op == COMBINE_UNION;
+    const __m128 negate = _mm_set1_ps(op == COMBINE_SUBTRACT ? -0.0f : 0.0f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 vk = _mm_set1_ps(k);
+    const __m128 quarter_k = _mm_set1_ps(k * 0.25f);
+
+    __m128 result_min = _mm_set1_ps(INFINITY);
+    __m128 diff = _mm_setzero_ps();
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        __m128 a = _mm_loadu_ps(row + i);
+        __m128 b = _mm_xor_ps(_mm_loadu_ps(other + i), negate);
+        __m128 r = is_union ? _mm_max_ps(a, b) : _mm_min_ps(a, b);
+
+        if(k > 0.0f){
+            __m128 d = _mm_and_ps(_mm_sub_ps(a, b), abs_mask);
+            __m128 h = _mm_and_ps(_mm_cmplt_ps(d, vk), _mm_div_ps(_mm_sub_ps(vk, d), vk));
+            __m128 bump = _mm_mul_ps(_mm_mul_ps(h, h), quarter_k);
+            r = is_union ? _mm_add_ps(r, bump) : _mm_sub_ps(r, bump);
+        }
+
+        diff = _mm_or_ps(diff, _mm_cmpneq_ps(r, a));
+        _mm_storeu_ps(row + i, r);
+        result_min = _mm_min_ps(r, result_min);
+    }
+
+    result_min = _mm_min_ps(result_min, _mm_movehl_ps(result_min, result_min));
+    result_min = _mm_min_ss(result_min, _mm_shuffle_ps(result_min, result_min, 1));
+    float vector_min = _mm_cvtss_f32(result_min);
+    changed = changed || _mm_movemask_ps(diff) != 0;
+
+    float tail_min = combine_scalar(row + i, other + i, count - i, op, k, changed);
+    return tail_min < vector_min ? tail_min : vector_min;
+}
+
+void add_sse2(float *row, std::size_t count, float value){
+    const __m128 v = _mm_set1_ps(value);
+
+    std::size_t i = 0;
+    for(; i + 4 <= count; i += 4){
+        _mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), v));
+    }
+
+    add_scalar(row + i, count - i, value);
+}
+
+__attribute__((target("avx2")))
+void circle_span_avx2(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr){
+    const __m256 w = _mm256_set1_ps(width);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 vcx = _mm256_set1_ps(cx);
+    const __m256 vdy2 = _mm256_set1_ps(dy2);
+    const __m256 vcr = _mm256_set1_ps(cr);
+    const __m256i step = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i next = _mm256_set1_epi32(16);
+
+    std::size_t x = begin;
+    for(; x + 16 <= end; x += 16){
+        __m256i ix0 = _mm256_add_epi32(_mm256_set1_epi32((int)(2 * x)), step);
+        __m256i ix1 = _mm256_add_epi32(ix0, next);
+
+        __m256 dx0 = _mm256_sub_ps(_mm256_sub_ps(_mm256_div_ps(_mm256_cvtepi32_ps(ix0), w), one), vcx);
+        __m256 dx1 = _mm256_sub_ps(_mm256_sub_ps(_mm256_div_ps(_mm256_cvtepi32_ps(ix1), w), one), vcx);
+        __m256 v0 = _mm256_sub_ps(vcr, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx0, dx0), vdy2)));
+        __m256 v1 = _mm256_sub_ps(vcr, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx1, dx1), vdy2)));
+
+        _mm256_storeu_ps(row + x, _mm256_max_ps(v0, _mm256_loadu_ps(row + x)));
+        _mm256_storeu_ps(row + x + 8, _mm256_max_ps(v1, _mm256_loadu_ps(row + x + 8)));
+    }
+
+    circle_span_sse2(row, x, end, width, cx, dy2, cr);
+}
+
+__attribute__((target("avx2")))
+float min_avx2(const float *data, std::size_t count){
+    __m256 m = _mm256_set1_ps(INFINITY);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        m = _mm256_min_ps(_mm256_loadu_ps(data + i), m);
+    }
+
+    __m128 h = _mm_min_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+    h = _mm_min_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_min_ss(h, _mm_shuffle_ps(h, h, 1));
+    float result = _mm_cvtss_f32(h);
+
+    for(; i < count; i++){
+        result = data[i] < result ? data[i] : result;
+    }
+    return result;
+}
+
+//shuffles work within 128 bit lanes, the 64 bit permute puts the pairs of results back in order
+__attribute__((target("avx2")))
+void downsample_avx2(const float *row0, const float *row1, float *out, std::size_t count){
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256 a0 = _mm256_loadu_ps(row0 + 2 * i);
+        __m256 a1 = _mm256_loadu_ps(row0 + 2 * i + 8);
+        __m256 b0 = _mm256_loadu_ps(row1 + 2 * i);
+        __m256 b1 = _mm256_loadu_ps(row1 + 2 * i + 8);
+
+        __m256 a = _mm256_add_ps(_mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256 b = _mm256_add_ps(_mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256 result = _mm256_mul_ps(_mm256_add_ps(a, b), quarter);
+        result = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(result), _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(out + i, result);
+    }
+
+    downsample_sse2(row0 + 2 * i, row1 + 2 * i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+float combine_avx2(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed){
+    const bool is_union = op == COMBINE_UNION;
+    const __m256 negate = _mm256_set1_ps(op == COMBINE_SUBTRACT ? -0.0f : 0.0f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 vk = _mm256_set1_ps(k);
+    const __m256 quarter_k = _mm256_set1_ps(k * 0.25f);
+
+    __m256 result_min = _mm256_set1_ps(INFINITY);
+    __m256 diff = _mm256_setzero_ps();
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256 a = _mm256_loadu_ps(row + i);
+        __m256 b = _mm256_xor_ps(_mm256_loadu_ps(other + i), negate);
+        __m256 r = is_union ? _mm256_max_ps(a, b) : _mm256_min_ps(a, b);
+
+        if(k > 0.0f){
+            __m256 d = _mm256_and_ps(_mm256_sub_ps(a, b), abs_mask);
+            __m256 h = _mm256_and_ps(_mm256_cmp_ps(d, vk, _CMP_LT_OQ), _mm256_div_ps(_mm256_sub_ps(vk, d), vk));
+            __m256 bump = _mm256_mul_ps(_mm256_mul_ps(h, h), quarter_k);
+            r = is_union ? _mm256_add_ps(r, bump) : _mm256_sub_ps(r, bump);
+        }
+
+        diff = _mm256_or_ps(diff, _mm256_cmp_ps(r, a, _CMP_NEQ_UQ));
+        _mm256_storeu_ps(row + i, r);
+        result_min = _mm256_min_ps(r, result_min);
+    }
+
+    __m128 h = _mm_min_ps(_mm256_castps256_ps128(result_min), _mm256_extractf128_ps(result_min, 1));
+    h = _mm_min_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_min_ss(h, _mm_shuffle_ps(h, h, 1));
+    float vector_min = _mm_cvtss_f32(h);
+    changed = changed || _mm256_movemask_ps(diff) != 0;
+
+    //the compiler keeps vector_min in a register across the call and leaves out the vzeroupper,
+    //without it every legacy sse instruction of the tail pays the avx transition
+    _mm256_zeroupper();
+    float tail_min = combine_sse2(row + i, other + i, count - i, op, k, changed);
+    return tail_min < vector_min ? tail_min : vector_min;
+}
+
+__attribute__((target("avx2")))
+void add_avx2(float *row, std::size_t count, float value){
+    const __m256 v = _mm256_set1_ps(value);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        _mm256_storeu_ps(row + i, _mm256_add_ps(_mm256_loadu_ps(row + i), v));
+    }
+
+    _mm256_zeroupper();
+    add_sse2(row + i, count - i, value);
+}
+
+//the taps of eight fragments are gathered, lanes outside the field keep the zero border
+__attribute__((target("avx2")))
+inline __m256 sample_gather_avx2(const float *field, __m256i x, __m256i y, __m256i w, __m256i h){
+    const __m256i none = _mm256_set1_epi32(-1);
+    __m256i inside = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(x, none), _mm256_cmpgt_epi32(w, x)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(y, none), _mm256_cmpgt_epi32(h, y))
+    );
+    __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y, w), x);
+
+    __m256 f = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), field, index, _mm256_castsi256_ps(inside), 4);
+    f = _mm256_max_ps(f, _mm256_set1_ps(-SAMPLE_LIMIT));
+    return _mm256_min_ps(f, _mm256_set1_ps(SAMPLE_LIMIT));
+}
+
+__attribute__((target("avx2")))
+void sample_avx2(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count){
+    //gather indices are 32 bit
+    if(width * height > (std::size_t)INT32_MAX / 2){
+        sample_sse2(field, width, height, u, v, out, count);
+        return;
+    }
+
+    const __m256 min_c = _mm256_set1_ps(-2.0f);
+    const __m256 max_u = _mm256_set1_ps((float)width + 1.0f);
+    const __m256 max_v = _mm256_set1_ps((float)height + 1.0f);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i w = _mm256_set1_epi32((int)width);
+    const __m256i h = _mm256_set1_epi32((int)height);
+    const __m256i onei = _mm256_set1_epi32(1);
+
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256 fu = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(u + i), min_c), max_u);
+        __m256 fv = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(v + i), min_c), max_v);
+        __m256 x0 = _mm256_floor_ps(fu);
+        __m256 y0 = _mm256_floor_ps(fv);
+        __m256 a = _mm256_sub_ps(fu, x0);
+        __m256 b = _mm256_sub_ps(fv, y0);
+        __m256i x = _mm256_cvttps_epi32(x0);
+        __m256i y = _mm256_cvttps_epi32(y0);
+        __m256i x1 = _mm256_add_epi32(x, onei);
+        __m256i y1 = _mm256_add_epi32(y, onei);
+
+        __m256 ia = _mm256_sub_ps(one, a);
+        __m256 r0 = _mm256_add_ps(
+            _mm256_mul_ps(sample_gather_avx2(field, x, y, w, h), ia),
+            _mm256_mul_ps(sample_gather_avx2(field, x1, y, w, h), a)
+        );
+        __m256 r1 = _mm256_add_ps(
+            _mm256_mul_ps(sample_gather_avx2(field, x, y1, w, h), ia),
+            _mm256_mul_ps(sample_gather_avx2(field, x1, y1, w, h), a)
+        );
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(r0, _mm256_sub_ps(one, b)), _mm256_mul_ps(r1, b)));
+    }
+
+    sample_sse2(field, width, height, u + i, v + i, out + i, count - i);
+}
+
+#endif
+
+//SHAPEPP_ISA=scalar|sse2|avx2 caps the selected instruction set (for comparing paths)
+Dispatch select_dispatch() noexcept{
+    const char *cap = getenv("SHAPEPP_ISA");
+    bool allow_sse2 = !cap || strcmp(cap, "scalar") != 0;
+    bool allow_avx2 = allow_sse2 && (!cap || strcmp(cap, "sse2") != 0);
+    (void)allow_avx2;
+
+#ifdef SHAPE_KERNEL_X86
+    __builtin_cpu_init();
+    if(allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")){
+        return Dispatch{
+            circle_span_avx2, min_avx2, downsample_avx2,
+            combine_avx2, add_avx2,
+            sample_avx2, blend_sse2, blend_rgba8_sse2,
+            to_half_f16c, from_half_f16c,
+            to_snorm16_sse2, from_snorm16_sse2,
+            to_snorm8_sse2, from_snorm8_sse2,
+            "avx2"
+        };
+    }
+    if(allow_sse2){
+        return Dispatch{
+            circle_span_sse2, min_sse2, downsample_sse2,
+            combine_sse2, add_sse2,
+            sample_sse2, blend_sse2, blend_rgba8_sse2,
+            to_half_scalar, from_half_scalar,
+            to_snorm16_sse2, from_snorm16_sse2,
+            to_snorm8_sse2, from_snorm8_sse2,
+            "sse2"
+        };
+    }
+#endif
+
+    return Dispatch{
+        circle_span_scalar, min_scalar, downsample_scalar,
+        combine_scalar, add_scalar,
+        sample_scalar, blend_scalar, blend_rgba8_scalar,
+        to_half_scalar, from_half_scalar,
+        to_snorm_scalar<int16_t, 32767>, from_snorm_scalar<int16_t, 32767>,
+        to_snorm_scalar<int8_t, 127>, from_snorm_scalar<int8_t, 127>,
+        "scalar"
+    };
+}
+
+const Dispatch &dispatch() noexcept{
+    static const Dispatch d = select_dispatch();
+    return d;
+}
+
+}
+
+void circle_span(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr) noexcept{
+    dispatch().circle_span(row, begin, end, width, cx, dy2, cr);
+}
+
+float min(const float *data, std::size_t count) noexcept{
+    return dispatch().min(data, count);
+}
+
+void downsample(const float *row0, const float *row1, float *out, std::size_t count) noexcept{
+    dispatch().downsample(row0, row1, out, count);
+}
+
+float combine(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed) noexcept{
+    return dispatch().combine(row, other, count, op, k, changed);
+}
+
+void add(float *row, std::size_t count, float value) noexcept{
+    dispatch().add(row, count, value);
+}
+
+void sample(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count) noexcept{
+    dispatch().sample(field, width, height, u, v, out, count);
+}
+
+void blend(float *rgba, const float *value, std::size_t count, const float color[4], float power) noexcept{
+    dispatch().blend(rgba, value, count, color, power);
+}
+
+void blend(std::uint8_t *rgba, const float *value, std::size_t count, const float color[4], float power) noexcept{
+    dispatch().blend_rgba8(rgba, value, count, color, power);
+}
+
+void quantize(const float *in, void *out, std::size_t count, ShapeFormat::Format format, float range) noexcept{
+    switch (format){
+    case ShapeFormat::FORMAT_FLOAT32:
+        memcpy(out, in, count * sizeof(float));
+        break;
+    case ShapeFormat::FORMAT_FLOAT16:
+        dispatch().to_half(in, static_cast<uint16_t*>(out), count);
+        break;
+    case ShapeFormat::FORMAT_SNORM16:
+        dispatch().to_snorm16(in, static_cast<int16_t*>(out), count, range);
+        break;
+    case ShapeFormat::FORMAT_SNORM8:
+        dispatch().to_snorm8(in, static_cast<int8_t*>(out), count, range);
+        break;
+    }
+}
+
+void dequantize(const void *in, float *out, std::size_t count, ShapeFormat::Format format, float range) noexcept{
+    switch (format){
+    case ShapeFormat::FORMAT_FLOAT32:
+        memcpy(out, in, count * sizeof(float));
+        break;
+    case ShapeFormat::FORMAT_FLOAT16:
+        dispatch().from_half(static_cast<const uint16_t*>(in), out, count);
+        break;
+    case ShapeFormat::FORMAT_SNORM16:
+        dispatch().from_snorm16(static_cast<const int16_t*>(in), out, count, range);
+        break;
+    case ShapeFormat::FORMAT_SNORM8:
+        dispatch().from_snorm8(static_cast<const int8_t*>(in), out, count, range);
+        break;
+    }
+}
+
+const char *isa() noexcept{
+    return dispatch().isa;
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ShapeFormat.hpp"
+
+//vectorized inner loops of Shape, dispatched at runtime to avx2, sse2 or scalar code
+//every path produces bit identical results
+namespace ShapeKernel{
+    //gl space coordinate of the fragment column (row) i of a field size fragments wide (high),
+    //the coordinate circle_span computes for x, shared by everything that has to match its fragments bit for bit
+    inline float fragment_coord(std::size_t i, std::size_t size) noexcept{
+        return (float)(2 * i) / (float)size - 1.0f;
+    }
+
+    //row[x] = max(row[x], cr - sqrt((2x / width - 1 - cx)^2 + dy2)) for x in [begin, end)
+    void circle_span(float *row, std::size_t begin, std::size_t end, float width, float cx, float dy2, float cr) noexcept;
+
+    //+INFINITY if count == 0
+    float min(const float *data, std::size_t count) noexcept;
+
+    //out[i] = ((row0[2i] + row0[2i + 1]) + (row1[2i] + row1[2i + 1])) * 0.25 for i in [0, count)
+    void downsample(const float *row0, const float *row1, float *out, std::size_t count) noexcept;
+
+    enum CombineOp{
+        //max(a, b)
+        COMBINE_UNION,
+        //min(a, b)
+        COMBINE_INTERSECT,
+        //min(a, -b)
+        COMBINE_SUBTRACT,
+    };
+
+    //row[i] = op(row[i], other[i]) for i in [0, count), with k > 0 blended near the crease (polynomial smooth min):
+    //the union adds and the others subtract h * h * k / 4, h = max(k - |a - b|, 0) / k, b negated for subtract
+    //returns the minimum of the results (+INFINITY if count == 0), sets changed if any fragment changed
+    float combine(float *row, const float *other, std::size_t count, CombineOp op, float k, bool &changed) noexcept;
+
+    //row[i] += value for i in [0, count)
+    void add(float *row, std::size_t count, float value) noexcept;
+
+    //bilinear samples of a width x height field with a border of zeros, as GL_LINEAR with GL_CLAMP_TO_BORDER
+    //u[i], v[i] are in fragments, with fragment centers on integers (uv * size - 0.5)
+    //infinite fragments count as +-1e30, so zero filter weights never make nan
+    void sample(const float *field, std::size_t width, std::size_t height, const float *u, const float *v, float *out, std::size_t count) noexcept;
+
+    //blends color with alpha = clamp(value[i] * power, -1, 1) * color[3] over count float rgba pixels,
+    //as GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA blending does
+    void blend(float *rgba, const float *value, std::size_t count, const float color[4], float power) noexcept;
+    //blend into 8 bit unorm rgba pixels, color and alpha clamp to [0, 1] and results round to nearest
+    void blend(std::uint8_t *rgba, const float *value, std::size_t count, const float color[4], float power) noexcept;
+
+    //converts count fragments to the format, normalized formats store fragment / range
+    //floats round to nearest even, normalized values clamp to [-1, 1] (nan to -1)
+    void quantize(const float *in, void *out, std::size_t count, ShapeFormat::Format format, float range) noexcept;
+
+    //inverse of quantize, normalized formats give max(stored / scale, -1) * range
+    void dequantize(const void *in, float *out, std::size_t count, ShapeFormat::Format format, float range) noexcept;
+
+    //"avx2", "sse2" or "scalar"
+    const char *isa() noexcept;
+}
@@ -0,0 +1,87 @@
+#include "ShapePyramid.hpp"
+#include "ShapeKernel.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+ShapePyramid::ShapePyramid(const Shape::View &shape, ThreadPool *pool){
+    Level base;
+    base.width = shape.width;
+    base.height = shape.height;
+    base.fragments.resize(shape.width * shape.height);
+    ShapeKernel::dequantize(shape.fragments, base.fragments.data(), base.fragments.size(), shape.format, shape.range);
+    levels.push_back(std::move(base));
+
+    build(pool);
+}
+
+ShapePyramid::ShapePyramid(const Shape &shape, ThreadPool *pool)
+:ShapePyramid(shape.view(), pool){}
+
+std::size_t ShapePyramid::get_levels() const noexcept{
+    return levels.size();
+}
+
+Shape::View ShapePyramid::level(std::size_t level) const noexcept{
+    const Level &l = levels[level];
+    return Shape::View{l.fragments.data(), l.width, l.height, ShapeFormat::FORMAT_FLOAT32, 1.0f};
+}
+
+std::size_t ShapePyramid::select_level(const glm::mat4 &mvp, float viewport_width, float viewport_height) const noexcept{
+    //corners of the quad in pixels, the shaders compute v_pos * v_mvp
+    std::array<glm::vec2, 4> corners;
+    const std::array<glm::vec2, 4> quad = {glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(1, 1), glm::vec2(-1, 1)};
+    for(std::size_t i = 0; i < quad.size(); i++){
+        glm::vec4 clip = glm::vec4(quad[i].x, quad[i].y, 0.0f, 1.0f) * mvp;
+        if(!(clip.w > 0.0f)) return 0;
+
+        corners[i] = glm::vec2(clip.x / clip.w * 0.5f * viewport_width, clip.y / clip.w * 0.5f * viewport_height);
+    }
+
+    //mean length of the edges along u and along v
+    float u = (glm::distance(corners[0], corners[1]) + glm::distance(corners[3], corners[2])) * 0.5f;
+    float v = (glm::distance(corners[0], corners[3]) + glm::distance(corners[1], corners[2])) * 0.5f;
+    float texels_per_pixel = std::max(levels[0].width / u, levels[0].height / v);
+    if(!(texels_per_pixel > 1.0f)) return 0;
+
+    std::size_t level = (std::size_t)std::min(floorf(log2f(texels_per_pixel)), 64.0f);
+    return std::min(level, levels.size() - 1);
+}
+
+void ShapePyramid::build(ThreadPool *pool){
+    //an empty shape has no fragments to average, max(size / 2, 1) would make a level out of nothing
+    if(levels.back().width == 0 || levels.back().height == 0) return;
+
+    while(levels.back().width > 1 || levels.back().height > 1){
+        const Level &parent = levels.back();
+        Level level;
+        level.width = std::max<std::size_t>(parent.width / 2, 1);
+        level.height = std::max<std::size_t>(parent.height / 2, 1);
+        level.fragments.resize(level.width * level.height);
+
+        auto rows = [&](std::size_t begin, std::size_t end){
+            for(std::size_t y = begin; y < end; y++){
+                const float *row0 = &parent.fragments[std::min(2 * y, parent.height - 1) * parent.width];
+                const float *row1 = &parent.fragments[std::min(2 * y + 1, parent.height - 1) * parent.width];
+                float *out = &level.fragments[y * level.width];
+
+                if(parent.width == 1){
+                    out[0] = ((row0[0] + row0[0]) + (row1[0] + row1[0])) * 0.25f;
+                }
+                else{
+                    ShapeKernel::downsample(row0, row1, out, level.width);
+                }
+            }
+        };
+
+        if(pool){
+            pool->parallel_for(level.height, rows);
+        }
+        else{
+            rows(0, level.height);
+        }
+
+        levels.push_back(std::move(level));
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Shape.hpp"
+
+class ThreadPool;
+
+//mip chain of a shape, from the shape itself down to 1x1
+//each level halves the size of the previous one (rounding down, at least 1, like gl mip levels)
+//by averaging 2x2 fragments, odd sizes drop the last column or row
+//fragments are distances in gl space, not in texels, so every level keeps the scale of the shape
+//a shape of width or height 0 has only its own empty level
+class ShapePyramid final{
+public:
+    //non float views are dequantized, pool splits every level by rows
+    ShapePyramid(const Shape::View &shape, ThreadPool *pool = nullptr);
+    ShapePyramid(const Shape &shape, ThreadPool *pool = nullptr);
+
+    std::size_t get_levels() const noexcept;
+
+    //FORMAT_FLOAT32 fragments of the level, level 0 is a copy of the shape
+    //invalidated when the pyramid is destroyed
+    Shape::View level(std::size_t level) const noexcept;
+
+    //the level gl would sample for the shape rendered with mvp (see Shape::Renderer::render):
+    //log2 of the texels per pixel along the more minified side of the quad, rounded down and clamped to the levels
+    std::size_t select_level(const glm::mat4 &mvp, float viewport_width, float viewport_height) const noexcept;
+private:
+    struct Level{
+        std::vector<float> fragments;
+        std::size_t width;
+        std::size_t height;
+    };
+
+    void build(ThreadPool *pool);
+
+    std::vector<Level> levels;
+};
@@ -0,0 +1,153 @@
+#include "ShapeUploader.hpp"
+#include "ShapeKernel.hpp"
+#include <stdexcept>
+#include <string.h>
+
+ShapeUploader::ShapeUploader(GLsizei width, GLsizei height, ShapeFormat::Format format, float range, std::size_t buffers){
+    if(width <= 0 || height <= 0 || buffers == 0){
+        throw std::invalid_argument("invalid uploader size");
+    }
+
+    ShapeFormat::Header header = ShapeFormat::header_for(width, height, format, range);
+
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    this->range = header.range;
+    this->buffer_size = header.payload_size;
+    this->next = 0;
+    this->mapped = false;
+    this->ring.resize(buffers);
+
+    for(Slot &slot: ring){
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+        slot.fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+ShapeUploader::~ShapeUploader() noexcept{
+    if(mapped){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring[next].buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    for(Slot &slot: ring){
+        if(slot.fence) glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void ShapeUploader::allocate(GLuint texture) const noexcept{
+    GLint internal_format;
+    GLenum type;
+    Shape::Renderer::texture_format(format, internal_format, type);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    Shape::Renderer::set_texture_parameters(GL_TEXTURE_2D);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RED, type, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void *ShapeUploader::begin(){
+    if(mapped){
+        throw std::logic_error("upload already begun");
+    }
+
+    Slot &slot = ring[next];
+    if(slot.fence){
+        //the flush makes sure the fence gets signaled at all, waits in steps of a second
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        for(;;){
+            GLenum status = glClientWaitSync(slot.fence, flags, 1000000000);
+            if(status != GL_TIMEOUT_EXPIRED) break;
+            flags = 0;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    //the gpu is done with the buffer, so there is nothing to synchronize with
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    void *memory = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffer_size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if(!memory){
+        throw std::runtime_error("cannot map pixel buffer");
+    }
+
+    mapped = true;
+    return memory;
+}
+
+void ShapeUploader::end(GLuint texture){
+    if(!mapped){
+        throw std::logic_error("upload is not begun");
+    }
+
+    Slot &slot = ring[next];
+    mapped = false;
+    next = (next + 1) % ring.size();
+
+    GLint internal_format;
+    GLenum type;
+    Shape::Renderer::texture_format(format, internal_format, type);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, type, nullptr);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ShapeUploader::upload(const Shape::View &shape, GLuint texture){
+    if(shape.width != (std::size_t)width || shape.height != (std::size_t)height){
+        throw std::invalid_argument("shape size does not match the uploader");
+    }
+
+    std::size_t count = shape.width * shape.height;
+    std::vector<float> dequantized;
+    const float *fragments = static_cast<const float*>(shape.fragments);
+    bool same = shape.format == format && (!ShapeFormat::is_normalized(format) || shape.range == range);
+
+    if(!same && shape.format != ShapeFormat::FORMAT_FLOAT32){
+        dequantized.resize(count);
+        ShapeKernel::dequantize(shape.fragments, dequantized.data(), count, shape.format, shape.range);
+        fragments = dequantized.data();
+    }
+
+    void *memory = begin();
+    if(same){
+        memcpy(memory, shape.fragments, buffer_size);
+    }
+    else{
+        ShapeKernel::quantize(fragments, memory, count, format, range);
+    }
+    end(texture);
+}
+
+void ShapeUploader::upload(const Shape &shape, GLuint texture){
+    upload(shape.view(), texture);
+}
+
+GLsizei ShapeUploader::get_width() const noexcept{
+    return width;
+}
+
+GLsizei ShapeUploader::get_height() const noexcept{
+    return height;
+}
+
+ShapeFormat::Format ShapeUploader::get_format() const noexcept{
+    return format;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "Shape.hpp"
+
+//streams shapes of one size and format into textures through a ring of pixel buffer objects,
+//so the copy into the texture runs asynchronously while the next shape is written
+//
+//begin, end and upload need the gl context, the memory begin returns can be filled from any thread
+//allocate, end and upload leave 0 bound to GL_TEXTURE_2D of the active texture unit and GL_PIXEL_UNPACK_BUFFER
+//(as Shape::Renderer uploads do, querying the previous bindings would stall), so a Shape::Renderer
+//drawing in a frame needs end_frame and begin_frame around them
+class ShapeUploader final{
+public:
+    //invalid_argument if the size is not positive, the format or range is invalid or there are no buffers
+    ShapeUploader(GLsizei width, GLsizei height, ShapeFormat::Format format = ShapeFormat::FORMAT_FLOAT32, float range = 1.0f, std::size_t buffers = 2);
+    ~ShapeUploader() noexcept;
+
+    //allocates texture for the uploads, with the parameters of Shape::Renderer::shape_texture
+    void allocate(GLuint texture) const noexcept;
+
+    //maps the next buffer of the ring, waiting for the upload it was last used for if it is still running,
+    //returns width * height fragments of the format to write, rows bottom up like Shape::View
+    //runtime_error if the buffer cannot be mapped, logic_error if already begun
+    void *begin();
+    //unmaps the buffer and starts the upload of its fragments into texture (see allocate)
+    //logic_error if not begun
+    void end(GLuint texture);
+
+    //begin, the shape converted to the format, end
+    //invalid_argument if the shape is not width x height
+    void upload(const Shape::View &shape, GLuint texture);
+    void upload(const Shape &shape, GLuint texture);
+
+    GLsizei get_width() const noexcept;
+    GLsizei get_height() const noexcept;
+    ShapeFormat::Format get_format() const noexcept;
+private:
+    struct Slot{
+        GLuint buffer;
+        //signaled once the last upload from the buffer is done, nullptr if there is none
+        GLsync fence;
+    };
+
+    std::vector<Slot> ring;
+    std::size_t next;
+    bool mapped;
+    std::size_t buffer_size;
+
+    GLsizei width;
+    GLsizei height;
+    ShapeFormat::Format format;
+    float range;
+
+    ShapeUploader(const ShapeUploader &copy) noexcept = delete;
+    ShapeUploader &operator=(const ShapeUploader &copy) noexcept = delete;
+};
@@ -0,0 +1,260 @@
+#include "SoftwareRenderer.hpp"
+#include "ShapeKernel.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+SoftwareRenderer::SoftwareRenderer(std::size_t width, std::size_t height, Format format){
+    if(width == 0 || height == 0){
+        throw std::invalid_argument("SoftwareRenderer size can not be zero");
+    }
+
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    pool = nullptr;
+
+    if(format == FORMAT_RGBA8){
+        rgba8.assign(width * height * 4, 0);
+    }
+    else{
+        rgba32f.assign(width * height * 4, 0.0f);
+    }
+}
+
+void SoftwareRenderer::set_thread_pool(ThreadPool *pool) noexcept{
+    this->pool = pool;
+}
+
+ThreadPool *SoftwareRenderer::get_thread_pool() const noexcept{
+    return pool;
+}
+
+void SoftwareRenderer::clear(const glm::vec4 &color) noexcept{
+    if(format == FORMAT_RGBA8){
+        std::uint8_t bytes[4];
+        for(int c = 0; c < 4; c++){
+            bytes[c] = (std::uint8_t)(std::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+
+        for(std::size_t i = 0; i < rgba8.size(); i += 4){
+            std::copy(bytes, bytes + 4, &rgba8[i]);
+        }
+    }
+    else{
+        for(std::size_t i = 0; i < rgba32f.size(); i += 4){
+            std::copy(&color[0], &color[0] + 4, &rgba32f[i]);
+        }
+    }
+}
+
+void SoftwareRenderer::render(const Shape::View &shape, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp){
+    const float *field = fields(shape, scratch1);
+    draw(field, nullptr, shape.width, shape.height, color, power, 0.0f, mvp, tex_mvp);
+}
+
+void SoftwareRenderer::render(const Shape::View &shape, const glm::vec4 &color, float power, const glm::mat4 &mvp){
+    render(shape, color, power, mvp, IDENTITY);
+}
+
+void SoftwareRenderer::render(const Shape::View &shape, const glm::vec4 &color, float power){
+    render(shape, color, power, IDENTITY, IDENTITY);
+}
+
+void SoftwareRenderer::render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp){
+    if(shape1.width != shape2.width || shape1.height != shape2.height){
+        throw std::invalid_argument("morphed shapes have to be the same size");
+    }
+
+    const float *field1 = fields(shape1, scratch1);
+    const float *field2 = fields(shape2, scratch2);
+    draw(field1, field2, shape1.width, shape1.height, color, power, progress, mvp, tex_mvp);
+}
+
+void SoftwareRenderer::render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp){
+    render_morph(shape1, shape2, color, power, progress, mvp, IDENTITY);
+}
+
+void SoftwareRenderer::render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress){
+    render_morph(shape1, shape2, color, power, progress, IDENTITY, IDENTITY);
+}
+
+std::size_t SoftwareRenderer::get_width() const noexcept{
+    return width;
+}
+
+std::size_t SoftwareRenderer::get_height() const noexcept{
+    return height;
+}
+
+SoftwareRenderer::Format SoftwareRenderer::get_format() const noexcept{
+    return format;
+}
+
+const void *SoftwareRenderer::pixels() const noexcept{
+    if(format == FORMAT_RGBA8) return rgba8.data();
+    return rgba32f.data();
+}
+
+void *SoftwareRenderer::pixels() noexcept{
+    if(format == FORMAT_RGBA8) return rgba8.data();
+    return rgba32f.data();
+}
+
+const float *SoftwareRenderer::fields(const Shape::View &shape, std::vector<float> &scratch) const{
+    if(shape.format == ShapeFormat::FORMAT_FLOAT32){
+        return static_cast<const float*>(shape.fragments);
+    }
+
+    //a range of 1 keeps normalized fragments as fragment / range, as their textures sample
+    scratch.resize(shape.width * shape.height);
+    ShapeKernel::dequantize(shape.fragments, scratch.data(), scratch.size(), shape.format, 1.0f);
+    return scratch.data();
+}
+
+void SoftwareRenderer::draw(const float *field1, const float *field2, std::size_t field_width, std::size_t field_height,
+    const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp){
+    if(field_width == 0 || field_height == 0) return;
+
+    //clip = vec4(x, y, 0, 1) * mvp for a point (x, y) of the quad,
+    //so clip x, y and w are the homography h of (x, y, 1)
+    const double h[3][3] = {
+        {mvp[0][0], mvp[0][1], mvp[0][3]},
+        {mvp[1][0], mvp[1][1], mvp[1][3]},
+        {mvp[3][0], mvp[3][1], mvp[3][3]},
+    };
+
+    //the adjugate maps ndc (nx, ny, 1) back to (x, y, 1) * det / w
+    double adj[3][3];
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 3; c++){
+            adj[r][c] = h[(c + 1) % 3][(r + 1) % 3] * h[(c + 2) % 3][(r + 2) % 3]
+                - h[(c + 1) % 3][(r + 2) % 3] * h[(c + 2) % 3][(r + 1) % 3];
+        }
+    }
+
+    double det = h[0][0] * adj[0][0] + h[0][1] * adj[1][0] + h[0][2] * adj[2][0];
+    //the quad is seen edge on
+    if(!(fabs(det) > 0.0) || !isfinite(det)) return;
+
+    //scaled to map to (x, y, 1) / w, positive in front of the camera
+    float inv[3][3];
+    for(int r = 0; r < 3; r++){
+        for(int c = 0; c < 3; c++){
+            inv[r][c] = (float)(adj[r][c] / det);
+        }
+    }
+
+    //pixels the quad can cover, the whole target if part of it is behind the camera
+    std::size_t x_begin = 0;
+    std::size_t x_end = width;
+    std::size_t y_begin = 0;
+    std::size_t y_end = height;
+
+    double lo[2] = {INFINITY, INFINITY};
+    double hi[2] = {-INFINITY, -INFINITY};
+    bool bounded = true;
+    for(double x = -1.0; x <= 1.0; x += 2.0){
+        for(double y = -1.0; y <= 1.0; y += 2.0){
+            double w = h[2][0] * x + h[2][1] * y + h[2][2];
+            bounded = bounded && w > 0.0;
+
+            for(int i = 0; i < 2; i++){
+                double ndc = (h[i][0] * x + h[i][1] * y + h[i][2]) / w;
+                lo[i] = std::min(lo[i], ndc);
+                hi[i] = std::max(hi[i], ndc);
+            }
+        }
+    }
+
+    if(bounded && isfinite(lo[0]) && isfinite(lo[1]) && isfinite(hi[0]) && isfinite(hi[1])){
+        auto to_pixel = [](double ndc, std::size_t size){
+            return (std::size_t)std::clamp(floor((ndc + 1.0) * 0.5 * size), 0.0, (double)size);
+        };
+
+        x_begin = to_pixel(lo[0], width);
+        x_end = std::min(to_pixel(hi[0], width) + 1, width);
+        y_begin = to_pixel(lo[1], height);
+        y_end = std::min(to_pixel(hi[1], height) + 1, height);
+        if(x_begin >= x_end || y_begin >= y_end) return;
+    }
+
+    //uv = (vec4(x, y, 1, 1) * tex_mvp).xy * 0.5 + 0.5, in fragments with centers on integers
+    const float fw = (float)field_width;
+    const float fh = (float)field_height;
+    const float tu[3] = {tex_mvp[0][0] * 0.5f * fw, tex_mvp[0][1] * 0.5f * fw, ((tex_mvp[0][2] + tex_mvp[0][3]) * 0.5f + 0.5f) * fw - 0.5f};
+    const float tv[3] = {tex_mvp[1][0] * 0.5f * fh, tex_mvp[1][1] * 0.5f * fh, ((tex_mvp[1][2] + tex_mvp[1][3]) * 0.5f + 0.5f) * fh - 0.5f};
+    //clip z and w, for the near and far planes
+    const float zr[3] = {mvp[2][0], mvp[2][1], mvp[2][3]};
+    const float wr[3] = {mvp[3][0], mvp[3][1], mvp[3][3]};
+
+    const float rgba[4] = {color.r, color.g, color.b, color.a};
+    const float actual_power = (float)height * power;
+
+    auto rows = [&](std::size_t begin, std::size_t end){
+        float u[SPAN];
+        float v[SPAN];
+        float value[SPAN];
+        float value2[SPAN];
+
+        for(std::size_t y = y_begin + begin; y < y_begin + end; y++){
+            float ny = (float)(2 * y + 1) / (float)height - 1.0f;
+            float row_x = inv[0][1] * ny + inv[0][2];
+            float row_y = inv[1][1] * ny + inv[1][2];
+            float row_s = inv[2][1] * ny + inv[2][2];
+
+            for(std::size_t span = x_begin; span < x_end; span += SPAN){
+                std::size_t count = std::min(SPAN, x_end - span);
+                std::size_t first = count;
+                std::size_t last = 0;
+
+                for(std::size_t i = 0; i < count; i++){
+                    float nx = (float)(2 * (span + i) + 1) / (float)width - 1.0f;
+                    float s = inv[2][0] * nx + row_s;
+                    float qx = (inv[0][0] * nx + row_x) / s;
+                    float qy = (inv[1][0] * nx + row_y) / s;
+                    float cz = qx * zr[0] + qy * zr[1] + zr[2];
+                    float cw = qx * wr[0] + qy * wr[1] + wr[2];
+
+                    //pixels between covered ones sample the border, which leaves them unchanged
+                    u[i] = -2.0f;
+                    v[i] = -2.0f;
+                    if(s > 0.0f && fabsf(qx) <= 1.0f && fabsf(qy) <= 1.0f && cz >= -cw && cz <= cw){
+                        u[i] = qx * tu[0] + qy * tu[1] + tu[2];
+                        v[i] = qx * tv[0] + qy * tv[1] + tv[2];
+                        first = std::min(first, i);
+                        last = i;
+                    }
+                }
+
+                if(first == count) continue;
+
+                std::size_t covered = last + 1 - first;
+                ShapeKernel::sample(field1, field_width, field_height, u + first, v + first, value, covered);
+
+                if(field2){
+                    ShapeKernel::sample(field2, field_width, field_height, u + first, v + first, value2, covered);
+                    for(std::size_t i = 0; i < covered; i++){
+                        value[i] = value[i] * (1.0f - progress) + value2[i] * progress;
+                    }
+                }
+
+                std::size_t pixel = (y * width + span + first) * 4;
+                if(format == FORMAT_RGBA8){
+                    ShapeKernel::blend(&rgba8[pixel], value, covered, rgba, actual_power);
+                }
+                else{
+                    ShapeKernel::blend(&rgba32f[pixel], value, covered, rgba, actual_power);
+                }
+            }
+        }
+    };
+
+    if(pool){
+        pool->parallel_for(y_end - y_begin, rows);
+    }
+    else{
+        rows(0, y_end - y_begin);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Shape.hpp"
+
+class ThreadPool;
+
+//draws shapes like Shape::Renderer does, but on the cpu into pixels in memory, no gl context needed
+//(thumbnails, previews on machines without a gpu)
+//
+//the pixels are what Shape::Renderer draws into a framebuffer of the same size and format with the viewport
+//covering it and GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA blending, up to rounding:
+//pixel centers inside the quad projected by mvp are shaded, with perspective correct uv
+//and bilinear sampling with a border of zeros
+//rows go bottom up, as glReadPixels returns them
+class SoftwareRenderer final{
+public:
+    inline static const glm::mat4 IDENTITY = Shape::Renderer::IDENTITY;
+
+    enum Format{
+        //4 bytes per pixel, colors and alpha clamp to [0, 1] as in a GL_RGBA8 framebuffer
+        FORMAT_RGBA8,
+        //4 floats per pixel, unclamped as in a GL_RGBA32F framebuffer
+        FORMAT_RGBA32F,
+    };
+
+    //width x height pixels cleared to zero, render power is relative to the height
+    //invalid_argument if a size is zero
+    SoftwareRenderer(std::size_t width, std::size_t height, Format format = FORMAT_RGBA8);
+
+    //render calls split the rows into bands, one per pool thread
+    //nullptr (default) or a pool of size 1 renders on the calling thread
+    void set_thread_pool(ThreadPool *pool) noexcept;
+    ThreadPool *get_thread_pool() const noexcept;
+
+    //colors clamp to [0, 1] in FORMAT_RGBA8
+    void clear(const glm::vec4 &color) noexcept;
+
+    //shapes of normalized formats sample as fragment / range, as their textures do
+    void render(const Shape::View &shape, const glm::vec4 &color, float power, const glm::mat4 &mvp, const glm::mat4 &tex_mvp);
+    void render(const Shape::View &shape, const glm::vec4 &color, float power, const glm::mat4 &mvp);
+    void render(const Shape::View &shape, const glm::vec4 &color, float power);
+    //invalid_argument if the shapes differ in size
+    void render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp);
+    void render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp);
+    void render_morph(const Shape::View &shape1, const Shape::View &shape2, const glm::vec4 &color, float power, float progress);
+
+    std::size_t get_width() const noexcept;
+    std::size_t get_height() const noexcept;
+    Format get_format() const noexcept;
+
+    //width * height * 4 channels, uint8_t for FORMAT_RGBA8, float for FORMAT_RGBA32F
+    const void *pixels() const noexcept;
+    void *pixels() noexcept;
+private:
+    //pixels of a row shaded at once, the scratch of a row lives on the stack
+    static constexpr std::size_t SPAN = 256;
+
+    //fragments of a view as floats, dequantized into scratch for normalized and half formats
+    const float *fields(const Shape::View &shape, std::vector<float> &scratch) const;
+    void draw(const float *field1, const float *field2, std::size_t field_width, std::size_t field_height,
+        const glm::vec4 &color, float power, float progress, const glm::mat4 &mvp, const glm::mat4 &tex_mvp);
+
+    std::size_t width;
+    std::size_t height;
+    Format format;
+    std::vector<std::uint8_t> rgba8;
+    std::vector<float> rgba32f;
+    std::vector<float> scratch1;
+    std::vector<float> scratch2;
+
+    ThreadPool *pool;
+
+    SoftwareRenderer(const SoftwareRenderer &copy) noexcept = delete;
+    SoftwareRenderer &operator=(const SoftwareRenderer &copy) noexcept = delete;
+};
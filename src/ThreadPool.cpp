@@ -0,0 +1,88 @@
+#include "ThreadPool.hpp"
+
+//set while the thread runs a band of any pool: parallel_for from there runs inline,
+//waiting on a pool whose threads may be the ones waiting for this band would deadlock
+static thread_local bool in_band = false;
+
+ThreadPool::ThreadPool(std::size_t size){
+    task = nullptr;
+    ctx = nullptr;
+    count = 0;
+    generation = 0;
+    pending = 0;
+    stop = false;
+
+    for(std::size_t band = 1; band < size; band++){
+        threads.emplace_back(&ThreadPool::work, this, band);
+    }
+}
+
+ThreadPool::~ThreadPool() noexcept{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    start.notify_all();
+
+    for(auto &thread:threads){
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::size() const noexcept{
+    return threads.size() + 1;
+}
+
+void ThreadPool::run(std::size_t count, Task task, const void *ctx) noexcept{
+    if(threads.empty() || count < 2 || in_band){
+        if(count) task(ctx, 0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = task;
+        this->ctx = ctx;
+        this->count = count;
+        pending = threads.size();
+        generation++;
+    }
+    start.notify_all();
+
+    run_band(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{return pending == 0;});
+}
+
+void ThreadPool::run_band(std::size_t band) noexcept{
+    std::size_t begin = count * band / size();
+    std::size_t end = count * (band + 1) / size();
+
+    if(begin < end){
+        in_band = true;
+        task(ctx, begin, end);
+        in_band = false;
+    }
+}
+
+void ThreadPool::work(std::size_t band) noexcept{
+    std::size_t seen = 0;
+
+    for(;;){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&]{return stop || generation != seen;});
+            if(stop) return;
+            seen = generation;
+        }
+
+        run_band(band);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if(--pending == 0){
+            done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class ThreadPool final{
+public:
+    //size is the number of threads parallel_for runs on, including the calling one
+    //size 1 starts no threads
+    explicit ThreadPool(std::size_t size = std::thread::hardware_concurrency());
+    ~ThreadPool() noexcept;
+
+    std::size_t size() const noexcept;
+
+    //splits [0, count) into size() contiguous bands, calls fn(begin, end) for each non empty band
+    //and blocks until all of them are done, fn must not throw
+    //called from inside fn of any pool (e.g. a Shape drawn in a SoftwareRenderer band sharing the pool),
+    //runs fn(0, count) inline on the calling thread instead
+    template<typename Fn>
+    void parallel_for(std::size_t count, const Fn &fn) noexcept{
+        run(count, [](const void *ctx, std::size_t begin, std::size_t end){
+            (*static_cast<const Fn*>(ctx))(begin, end);
+        }, &fn);
+    }
+private:
+    typedef void (*Task)(const void *ctx, std::size_t begin, std::size_t end);
+
+    void run(std::size_t count, Task task, const void *ctx) noexcept;
+    void run_band(std::size_t band) noexcept;
+    void work(std::size_t band) noexcept;
+
+    std::vector<std::thread> threads;
+
+    //one parallel_for at a time
+    std::mutex run_mutex;
+
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    Task task;
+    const void *ctx;
+    std::size_t count;
+    std::size_t generation;
+    std::size_t pending;
+    bool stop;
+
+    ThreadPool(const ThreadPool &copy) noexcept = delete;
+    ThreadPool &operator=(const ThreadPool &copy) noexcept = delete;
+};
@@ -0,0 +1,504 @@
+//micro benchmarks of baking, stream i/o, texture uploads and rendering, built and run by `make bench`
+//
+//every benchmark times batches of operations until a batch takes MIN_SAMPLE_SECONDS,
+//then reports the median and minimum time per operation of SAMPLES such batches (run_watched ones leave setup out)
+//gl benchmarks run in a surfaceless egl context (llvmpipe without a gpu) and finish the gl work in the timing
+//results go to stdout as json, --json FILE and --csv FILE write them to files instead
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+#include "../glutil/HeadlessContext.hpp"
+#include "../Shape.hpp"
+#include "../ShapeKernel.hpp"
+#include "../ShapeExpr.hpp"
+#include "../SoftwareRenderer.hpp"
+#include "../ThreadPool.hpp"
+
+namespace{
+
+constexpr double MIN_SAMPLE_SECONDS = 0.05;
+constexpr std::size_t SAMPLES = 7;
+//batches also stop growing at this wall time, which includes the untimed setup of run_watched
+constexpr double MAX_SAMPLE_WALL_SECONDS = 0.5;
+
+struct Result{
+    std::string name;
+    std::string params;
+    //operations per sample
+    std::size_t iterations;
+    double median_ns;
+    double min_ns;
+    //bytes one operation processes, 0 if throughput does not apply
+    double bytes;
+};
+
+//sums the time between start and stop calls
+class Stopwatch{
+public:
+    void start() noexcept{
+        begin = std::chrono::steady_clock::now();
+    }
+
+    void stop() noexcept{
+        total += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    double seconds() const noexcept{
+        return total;
+    }
+private:
+    std::chrono::steady_clock::time_point begin;
+    double total = 0.0;
+};
+
+//text as a json string literal
+std::string json_string(const std::string &text){
+    std::string json = "\"";
+    for(char c:text){
+        if(c == '"' || c == '\\'){
+            json += '\\';
+            json += c;
+        }
+        else if((unsigned char)c < 0x20){
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)(unsigned char)c);
+            json += escape;
+        }
+        else{
+            json += c;
+        }
+    }
+    return json + "\"";
+}
+
+class Bench{
+public:
+    explicit Bench(const std::string &filter): filter(filter){}
+
+    //fn(n) performs the operation n times
+    template<typename Fn>
+    void run(const std::string &name, const std::string &params, double bytes, const Fn &fn){
+        measure(name, params, bytes, [&](std::size_t n){
+            Stopwatch watch;
+            watch.start();
+            fn(n);
+            watch.stop();
+            return watch.seconds();
+        });
+    }
+
+    //fn(n, watch) performs the operation n times, timing only what runs between watch.start() and watch.stop(),
+    //for operations that need untimed setup before every repetition
+    template<typename Fn>
+    void run_watched(const std::string &name, const std::string &params, double bytes, const Fn &fn){
+        measure(name, params, bytes, [&](std::size_t n){
+            Stopwatch watch;
+            fn(n, watch);
+            return watch.seconds();
+        });
+    }
+
+    void write_json(std::ostream &out, const std::string &gl_renderer) const{
+        out << "{\n  \"isa\": " << json_string(ShapeKernel::isa()) << ",\n  \"gl_renderer\": " << json_string(gl_renderer) << ",\n  \"results\": [";
+
+        for(std::size_t i = 0; i < results.size(); i++){
+            const Result &r = results[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": " << json_string(r.name) << ", \"params\": " << json_string(r.params)
+                << ", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << r.median_ns
+                << ", \"min_ns_per_op\": " << r.min_ns
+                << ", \"ops_per_s\": " << 1e9 / r.median_ns
+                << ", \"bytes_per_s\": " << r.bytes * 1e9 / r.median_ns << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void write_csv(std::ostream &out) const{
+        out << "name,params,iterations,ns_per_op,min_ns_per_op,ops_per_s,bytes_per_s\n";
+        for(const Result &r:results){
+            out << r.name << "," << r.params << "," << r.iterations << "," << r.median_ns << "," << r.min_ns
+                << "," << 1e9 / r.median_ns << "," << r.bytes * 1e9 / r.median_ns << "\n";
+        }
+    }
+private:
+    //seconds(n) is the time n operations take
+    template<typename Fn>
+    void measure(const std::string &name, const std::string &params, double bytes, const Fn &seconds){
+        if(!filter.empty() && (name + " " + params).find(filter) == std::string::npos) return;
+
+        std::size_t n = 1;
+        for(;;){
+            auto begin = std::chrono::steady_clock::now();
+            double timed = seconds(n);
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            if(timed >= MIN_SAMPLE_SECONDS || wall >= MAX_SAMPLE_WALL_SECONDS || n >= ((std::size_t)1 << 30)) break;
+            n *= 2;
+        }
+
+        std::vector<double> ns;
+        for(std::size_t i = 0; i < SAMPLES; i++){
+            ns.push_back(seconds(n) * 1e9 / n);
+        }
+        std::sort(ns.begin(), ns.end());
+
+        results.push_back(Result{name, params, n, ns[ns.size() / 2], ns.front(), bytes});
+        std::cerr << name << " " << params << ": " << ns[ns.size() / 2] << " ns" << std::endl;
+    }
+
+    std::string filter;
+    std::vector<Result> results;
+};
+
+std::vector<Shape::Circle> random_circles(std::size_t count, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> pos(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> radius(0.02f, 0.2f);
+
+    std::vector<Shape::Circle> circles;
+    for(std::size_t i = 0; i < count; i++){
+        circles.push_back(Shape::Circle{glm::vec2(pos(random), pos(random)), radius(random)});
+    }
+    return circles;
+}
+
+Shape baked_shape(std::size_t size){
+    Shape shape(size, size);
+    shape.draw_circles(random_circles(64, 1));
+    return shape;
+}
+
+std::string params(const char *format, std::size_t a, std::size_t b = 0){
+    char text[128];
+    snprintf(text, sizeof(text), format, a, b);
+    return text;
+}
+
+//draws start from a blank shape, restored by an untimed copy before every operation,
+//construction alone is the "shape" benchmark
+void bench_baking(Bench &bench, ThreadPool &pool){
+    for(std::size_t size:{128, 512, 2048}){
+        bench.run("shape", params("size=%zu", size), size * size * sizeof(float), [&](std::size_t n){
+            for(std::size_t i = 0; i < n; i++){
+                Shape shape(size, size);
+            }
+        });
+
+        const Shape blank(size, size);
+        Shape shape(size, size);
+        for(std::size_t count:{1, 16, 256}){
+            std::vector<Shape::Circle> circles = random_circles(count, 2);
+
+            bench.run_watched("draw_circle", params("size=%zu circles=%zu", size, count), 0, [&](std::size_t n, Stopwatch &watch){
+                for(std::size_t i = 0; i < n; i++){
+                    shape = blank;
+                    watch.start();
+                    for(const Shape::Circle &circle:circles){
+                        shape.draw_circle(circle.pos, circle.radius);
+                    }
+                    watch.stop();
+                }
+            });
+
+            bench.run_watched("draw_circles", params("size=%zu circles=%zu", size, count), 0, [&](std::size_t n, Stopwatch &watch){
+                for(std::size_t i = 0; i < n; i++){
+                    shape = blank;
+                    watch.start();
+                    shape.draw_circles(circles);
+                    watch.stop();
+                }
+            });
+
+            bench.run_watched("draw_circles_pool", params("size=%zu circles=%zu", size, count) + params(" threads=%zu", pool.size()), 0, [&](std::size_t n, Stopwatch &watch){
+                for(std::size_t i = 0; i < n; i++){
+                    shape = blank;
+                    shape.set_thread_pool(&pool);
+                    watch.start();
+                    shape.draw_circles(circles);
+                    watch.stop();
+                }
+            });
+        }
+    }
+}
+
+//operations repeat on one shape, smooth unions keep raising it but every pass still visits the whole field
+void bench_csg(Bench &bench, ThreadPool &pool){
+    for(std::size_t size:{512, 2048}){
+        Shape shape = baked_shape(size);
+        Shape other(size, size);
+        other.draw_circles(random_circles(64, 3));
+        double bytes = 2.0 * size * size * sizeof(float);
+
+        for(float k:{0.0f, 0.05f}){
+            std::string p = params("size=%zu", size) + (k > 0.0f ? " smooth" : "");
+            bench.run("unite", p, bytes, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    shape.unite(other, k);
+                }
+            });
+
+            bench.run("subtract", p, bytes, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    shape.subtract(other, k);
+                }
+            });
+
+            bench.run("unite_pool", p + params(" threads=%zu", pool.size()), bytes, [&](std::size_t n){
+                shape.set_thread_pool(&pool);
+                for(std::size_t i = 0; i < n; i++){
+                    shape.unite(other, k);
+                }
+                shape.set_thread_pool(nullptr);
+            });
+        }
+
+        bench.run("subtract_circle", params("size=%zu", size), bytes / 2.0, [&](std::size_t n){
+            for(std::size_t i = 0; i < n; i++){
+                shape.subtract(Shape::Circle{glm::vec2(0.1f, -0.2f), 0.3f});
+            }
+        });
+    }
+}
+
+//circles[0] united with, every third one subtracted, circles[1..N] alternating sharp and smooth, 2N + 1 nodes
+template<std::size_t N>
+auto expr_chain(const std::vector<Shape::Circle> &circles){
+    if constexpr(N == 0){
+        return ShapeExpr::circle(circles[0]);
+    }
+    else if constexpr(N % 3 == 0){
+        return ShapeExpr::subtract(expr_chain<N - 1>(circles), ShapeExpr::circle(circles[N]), 0.01f);
+    }
+    else{
+        return ShapeExpr::unite(expr_chain<N - 1>(circles), ShapeExpr::circle(circles[N]), N % 2 ? 0.0f : 0.05f);
+    }
+}
+
+//the same 101 node tree baked lazily and applied as eager Shape operations
+void bench_expr(Bench &bench, ThreadPool &pool){
+    std::vector<Shape::Circle> circles = random_circles(51, 4);
+    auto expr = expr_chain<50>(circles);
+
+    for(std::size_t size:{512, 2048}){
+        const Shape blank(size, size);
+        Shape shape(size, size);
+        double bytes = size * size * sizeof(float);
+
+        bench.run("expr_bake", params("size=%zu nodes=101", size), bytes, [&](std::size_t n){
+            for(std::size_t i = 0; i < n; i++){
+                ShapeExpr::bake(expr, shape);
+            }
+        });
+
+        bench.run("expr_bake_pool", params("size=%zu nodes=101 threads=%zu", size, pool.size()), bytes, [&](std::size_t n){
+            shape.set_thread_pool(&pool);
+            for(std::size_t i = 0; i < n; i++){
+                ShapeExpr::bake(expr, shape);
+            }
+            shape.set_thread_pool(nullptr);
+        });
+
+        //bake overwrites shape, the eager operations start from a blank copy made outside the timing
+        bench.run_watched("expr_eager", params("size=%zu nodes=101", size), bytes, [&](std::size_t n, Stopwatch &watch){
+            for(std::size_t i = 0; i < n; i++){
+                shape = blank;
+                watch.start();
+                shape.draw_circle(circles[0].pos, circles[0].radius);
+                for(std::size_t c = 1; c < circles.size(); c++){
+                    if(c % 3 == 0){
+                        shape.subtract(circles[c], 0.01f);
+                    }
+                    else{
+                        shape.unite(circles[c], c % 2 ? 0.0f : 0.05f);
+                    }
+                }
+                watch.stop();
+            }
+        });
+    }
+}
+
+void bench_io(Bench &bench){
+    for(std::size_t size:{256, 1024}){
+        Shape shape = baked_shape(size);
+        double bytes = size * size * sizeof(float);
+
+        for(bool compress:{false, true}){
+            std::unique_ptr<FILE, int(*)(FILE*)> file(tmpfile(), fclose);
+            if(!file){
+                std::cerr << "no temporary file, skipping stream benchmarks" << std::endl;
+                return;
+            }
+
+            const char *kind = compress ? " compressed" : "";
+            bench.run("write_to_stream", params("size=%zu", size) + kind, bytes, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    rewind(file.get());
+                    shape.write_to_stream(file.get(), true, compress);
+                }
+                fflush(file.get());
+            });
+
+            bench.run("read_stream", params("size=%zu", size) + kind, bytes, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    rewind(file.get());
+                    Shape read(file.get());
+                }
+            });
+        }
+    }
+}
+
+void bench_software(Bench &bench, ThreadPool &pool){
+    Shape shape1 = baked_shape(256);
+    Shape shape2(256, 256);
+    shape2.draw_circle(glm::vec2(0.0f), 0.5f);
+    glm::mat4 mvp = glm::rotate(Shape::Renderer::IDENTITY, 0.5f, glm::vec3(0.0f, 0.0f, 1.0f));
+
+    for(std::size_t size:{256, 1024}){
+        for(ThreadPool *threads:{(ThreadPool*)nullptr, &pool}){
+            SoftwareRenderer renderer(size, size);
+            renderer.set_thread_pool(threads);
+            std::string p = params("target=%zu threads=%zu", size, threads ? threads->size() : 1);
+
+            bench.run("software_render", p, 0, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    renderer.render(shape1.view(), glm::vec4(0.2f, 0.4f, 0.8f, 1.0f), 0.5f, mvp);
+                }
+            });
+
+            bench.run("software_render_morph", p, 0, [&](std::size_t n){
+                for(std::size_t i = 0; i < n; i++){
+                    renderer.render_morph(shape1.view(), shape2.view(), glm::vec4(0.2f, 0.4f, 0.8f, 1.0f), 0.5f, 0.3f, mvp);
+                }
+            });
+        }
+    }
+}
+
+void bench_gl(Bench &bench){
+    const GLsizei target = 512;
+
+    GLuint color_buffer;
+    glGenRenderbuffers(1, &color_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, target, target);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+    glViewport(0, 0, target, target);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    Shape::Renderer renderer;
+    renderer.init();
+
+    GLuint textures[2];
+    glGenTextures(2, textures);
+
+    for(std::size_t size:{256, 1024}){
+        Shape shape = baked_shape(size);
+        bench.run("shape_texture", params("size=%zu", size), size * size * sizeof(float), [&](std::size_t n){
+            for(std::size_t i = 0; i < n; i++){
+                renderer.shape_texture(shape, textures[0]);
+            }
+            glFinish();
+        });
+    }
+
+    Shape shape1 = baked_shape(256);
+    Shape shape2(256, 256);
+    shape2.draw_circle(glm::vec2(0.0f), 0.5f);
+    renderer.shape_texture(shape1, textures[0]);
+    renderer.shape_texture(shape2, textures[1]);
+    glm::mat4 mvp = glm::rotate(Shape::Renderer::IDENTITY, 0.5f, glm::vec3(0.0f, 0.0f, 1.0f));
+    std::string p = params("target=%zu shape=%zu", target, 256);
+
+    renderer.begin_frame(target, target);
+    bench.run("render", p, 0, [&](std::size_t n){
+        for(std::size_t i = 0; i < n; i++){
+            renderer.render(textures[0], glm::vec4(0.2f, 0.4f, 0.8f, 1.0f), 0.5f, mvp);
+        }
+        glFinish();
+    });
+
+    bench.run("render_morph", p, 0, [&](std::size_t n){
+        for(std::size_t i = 0; i < n; i++){
+            renderer.render_morph(textures[0], textures[1], glm::vec4(0.2f, 0.4f, 0.8f, 1.0f), 0.5f, 0.3f, mvp);
+        }
+        glFinish();
+    });
+    renderer.end_frame();
+
+    glDeleteTextures(2, textures);
+    renderer.uninit();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color_buffer);
+}
+
+}
+
+int main(int argc, char **argv){
+    std::string json_file;
+    std::string csv_file;
+    std::string filter;
+
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(i + 1 < argc && arg == "--json") json_file = argv[++i];
+        else if(i + 1 < argc && arg == "--csv") csv_file = argv[++i];
+        else if(i + 1 < argc && arg == "--filter") filter = argv[++i];
+        else{
+            std::cerr << "usage: " << argv[0] << " [--json FILE] [--csv FILE] [--filter TEXT]" << std::endl;
+            return 1;
+        }
+    }
+
+    Bench bench(filter);
+    ThreadPool pool;
+
+    bench_baking(bench, pool);
+    bench_csg(bench, pool);
+    bench_expr(bench, pool);
+    bench_io(bench);
+    bench_software(bench, pool);
+
+    std::string gl_renderer = "none";
+    std::unique_ptr<GlUtil::HeadlessContext> context;
+    try{
+        context = std::make_unique<GlUtil::HeadlessContext>();
+    }
+    catch(std::exception &e){
+        std::cerr << e.what() << ", skipping gl benchmarks" << std::endl;
+    }
+
+    if(context){
+        gl_renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        bench_gl(bench);
+    }
+
+    if(!csv_file.empty()){
+        std::ofstream out(csv_file);
+        bench.write_csv(out);
+    }
+    if(!json_file.empty()){
+        std::ofstream out(json_file);
+        bench.write_json(out, gl_renderer);
+    }
+    if(csv_file.empty() && json_file.empty()){
+        bench.write_json(std::cout, gl_renderer);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "HeadlessContext.hpp"
+#include <EGL/eglext.h>
+#include <stdexcept>
+
+namespace GlUtil{
+
+HeadlessContext::HeadlessContext(){
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(get_platform_display){
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+#endif
+    if(display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)){
+        throw std::runtime_error("can not initialize an egl display");
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API)){
+        destroy();
+        throw std::runtime_error("egl display does not support opengl");
+    }
+
+    //EGL_KHR_no_config_context, with a pbuffer capable config as the fallback
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+    if(context == EGL_NO_CONTEXT){
+        const EGLint attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint count = 0;
+        if(eglChooseConfig(display, attributes, &config, 1, &count) && count == 1){
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+        }
+    }
+
+    //EGL_KHR_surfaceless_context, rendering only goes to framebuffer objects
+    if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)){
+        destroy();
+        throw std::runtime_error("can not create a surfaceless opengl context");
+    }
+
+    GLenum glew = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    //glew built for glx still loads the gl functions before failing to find an x display
+    if(glew == GLEW_ERROR_NO_GLX_DISPLAY) glew = GLEW_OK;
+#endif
+    if(glew != GLEW_OK){
+        destroy();
+        throw std::runtime_error("can not load opengl functions");
+    }
+}
+
+HeadlessContext::~HeadlessContext() noexcept{
+    destroy();
+}
+
+void HeadlessContext::destroy() noexcept{
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <EGL/egl.h>
+#include "_gl.hpp"
+
+namespace GlUtil{
+    //desktop gl context of a surfaceless egl display, current on the creating thread,
+    //for rendering into framebuffer objects without a window or display (e.g. llvmpipe)
+    class HeadlessContext final{
+    public:
+        //makes the context current and loads gl functions with glew
+        //runtime_error if no context can be created
+        HeadlessContext();
+        ~HeadlessContext() noexcept;
+    private:
+        void destroy() noexcept;
+
+        EGLDisplay display;
+        EGLContext context;
+
+        HeadlessContext(const HeadlessContext &copy) noexcept = delete;
+        HeadlessContext &operator=(const HeadlessContext &copy) noexcept = delete;
+    };
+}
@@ -1,8 +1,79 @@
 #include "Program.hpp"
+#include "../Profiler.hpp"
 #include <stdarg.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace GlUtil{
 
+namespace{
+
+//cache file, little endian host order:
+//    0   8   magic "SPPPROG1"
+//    8   u64 key               hash of the sources, defines, attribute locations and driver
+//    16  u64 binary_hash       hash of the binary
+//    24  u32 binary_format
+//    28  u32 binary_size
+//    32      binary
+const char CACHE_MAGIC[8] = {'S', 'P', 'P', 'P', 'R', 'O', 'G', '1'};
+const std::size_t CACHE_HEADER_SIZE = 32;
+
+std::string &cache_directory_storage(){
+    static std::string directory;
+    return directory;
+}
+
+//64 bit FNV-1a
+std::uint64_t hash(std::uint64_t seed, const void *data, std::size_t size) noexcept{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for(std::size_t i = 0; i < size; i++){
+        seed = (seed ^ bytes[i]) * 0x100000001B3ull;
+    }
+    return seed;
+}
+
+//strings are hashed with their terminator, so fields cannot run into each other
+std::uint64_t hash(std::uint64_t seed, const char *text) noexcept{
+    if(text == nullptr) text = "";
+    return hash(seed, text, strlen(text) + 1);
+}
+
+std::uint64_t cache_key(const char *vertex_src, const char *fragment_src, const std::string &defines, const std::vector<std::string> &attributes) noexcept{
+    std::uint64_t key = 0xCBF29CE484222325ull;
+    key = hash(key, (const char *)glGetString(GL_VENDOR));
+    key = hash(key, (const char *)glGetString(GL_RENDERER));
+    key = hash(key, (const char *)glGetString(GL_VERSION));
+    key = hash(key, (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION));
+    key = hash(key, defines.c_str());
+    key = hash(key, vertex_src);
+    key = hash(key, fragment_src);
+    //bound locations are part of the linked binary
+    for(const std::string &attribute:attributes){
+        key = hash(key, attribute.c_str());
+    }
+    return key;
+}
+
+std::string with_defines(const char *src, const std::string &defines){
+    std::string result = src;
+    if(defines.empty()) return result;
+
+    std::size_t version = result.find("#version");
+    std::size_t line_end = version == std::string::npos ? std::string::npos : result.find('\n', version);
+    if(line_end == std::string::npos){
+        return version == std::string::npos ? defines + "\n" + result : result + "\n" + defines + "\n";
+    }
+
+    result.insert(line_end + 1, defines + "\n");
+    return result;
+}
+
+}
+
 Program::Program() noexcept{
     _id = 0;
 }
@@ -12,6 +83,7 @@ Program::Program(GLuint id) noexcept{
 }
 
 Program Program::link_new(const Shader *shader,...){
+    Profiler::ScopedTimer timer(Profiler::CPU_PROGRAM_LINK);
     Program result;
     result.create();
 
@@ -46,6 +118,171 @@ Program Program::link_new(const Shader &first, const Shader &second, const Shade
     return link_new(&first, &second, &third, nullptr);
 }
 
+Program Program::build(const char *vertex_src, const char *fragment_src, const std::string &defines, const std::vector<std::string> &attributes){
+    std::string directory = cache_directory();
+    bool cache = !directory.empty() && binary_cache_supported();
+
+    std::uint64_t key = 0;
+    std::string path;
+    if(cache){
+        key = cache_key(vertex_src, fragment_src, defines, attributes);
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.progbin", (unsigned long long)key);
+        path = directory + name;
+
+        Program result;
+        if(load_binary(path, key, result)){
+            return result;
+        }
+    }
+
+    Shader vertex = Shader::compile_new(GL_VERTEX_SHADER, with_defines(vertex_src, defines).c_str());
+    Shader fragment;
+    try{
+        fragment = Shader::compile_new(GL_FRAGMENT_SHADER, with_defines(fragment_src, defines).c_str());
+    }
+    catch(std::runtime_error &){
+        vertex.delete_shader();
+        throw;
+    }
+
+    Program result;
+    result.create();
+    result.attach(vertex);
+    result.attach(fragment);
+    for(std::size_t i = 0; i < attributes.size(); i++){
+        glBindAttribLocation(result._id, i, attributes[i].c_str());
+    }
+    if(cache){
+        glProgramParameteri(result._id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    bool linked;
+    {
+        Profiler::ScopedTimer timer(Profiler::CPU_PROGRAM_LINK);
+        result.link();
+        linked = result.is_linked();
+    }
+
+    vertex.delete_shader();
+    fragment.delete_shader();
+
+    if(!linked){
+        std::string log = result.info_log();
+        result.delete_program();
+        throw std::runtime_error(log);
+    }
+
+    if(cache){
+        store_binary(directory, path, key, result);
+    }
+    return result;
+}
+
+void Program::set_cache_directory(const std::string &directory){
+    cache_directory_storage() = directory;
+}
+
+std::string Program::cache_directory(){
+    return cache_directory_storage();
+}
+
+bool Program::binary_cache_supported() noexcept{
+    if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+bool Program::load_binary(const std::string &path, std::uint64_t key, Program &result){
+    Profiler::ScopedTimer timer(Profiler::CPU_PROGRAM_LOAD);
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if(file == nullptr) return false;
+
+    std::vector<unsigned char> data;
+    unsigned char chunk[4096];
+    std::size_t read;
+    while((read = fread(chunk, 1, sizeof(chunk), file)) > 0){
+        data.insert(data.end(), chunk, chunk + read);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+
+    if(!ok || data.size() < CACHE_HEADER_SIZE || memcmp(data.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0){
+        return false;
+    }
+
+    std::uint64_t file_key, binary_hash;
+    std::uint32_t format, size;
+    memcpy(&file_key, &data[8], sizeof(file_key));
+    memcpy(&binary_hash, &data[16], sizeof(binary_hash));
+    memcpy(&format, &data[24], sizeof(format));
+    memcpy(&size, &data[28], sizeof(size));
+
+    const unsigned char *binary = data.data() + CACHE_HEADER_SIZE;
+    if(file_key != key || size != data.size() - CACHE_HEADER_SIZE
+    || hash(0xCBF29CE484222325ull, binary, size) != binary_hash){
+        return false;
+    }
+
+    //a driver update may reject binaries of the same version string
+    result.create();
+    glProgramBinary(result._id, format, binary, size);
+    if(!result.is_linked()){
+        //drivers may also raise GL_INVALID_ENUM or GL_INVALID_VALUE for a rejected binary,
+        //which the compilation taking over must not leave for the caller's glGetError
+        while(glGetError() != GL_NO_ERROR){}
+        result.delete_program();
+        return false;
+    }
+    return true;
+}
+
+//best effort, a cache that cannot be written only costs the next startup a compilation
+void Program::store_binary(const std::string &directory, const std::string &path, std::uint64_t key, const Program &program){
+    GLint length = 0;
+    program.get_iv(GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+
+    std::vector<unsigned char> data(CACHE_HEADER_SIZE + length);
+    GLsizei size = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program._id, length, &size, &format, &data[CACHE_HEADER_SIZE]);
+    if(size <= 0) return;
+    data.resize(CACHE_HEADER_SIZE + size);
+
+    std::uint64_t binary_hash = hash(0xCBF29CE484222325ull, &data[CACHE_HEADER_SIZE], size);
+    std::uint32_t format32 = format, size32 = size;
+    memcpy(&data[0], CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    memcpy(&data[8], &key, sizeof(key));
+    memcpy(&data[16], &binary_hash, sizeof(binary_hash));
+    memcpy(&data[24], &format32, sizeof(format32));
+    memcpy(&data[28], &size32, sizeof(size32));
+
+    mkdir(directory.c_str(), 0755);
+
+    //readers see either the old file or the complete new one, never a partial write,
+    //the temporary name is unique even for threads and processes storing the same key at once
+    std::string tmp = path + ".tmpXXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if(fd < 0) return;
+
+    FILE *file = fdopen(fd, "wb");
+    if(file == nullptr){
+        close(fd);
+        remove(tmp.c_str());
+        return;
+    }
+
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0){
+        remove(tmp.c_str());
+    }
+}
+
 //logic_error if already created 
 void Program::create(){
     if(_id == 0){
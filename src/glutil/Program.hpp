@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Shader.hpp"
+#include <cstdint>
+#include <vector>
 
 namespace GlUtil{
     class Program final{
@@ -17,6 +19,22 @@ namespace GlUtil{
         //logic_error if link error
         static Program link_new(const Shader &first, const Shader &second, const Shader &third);
 
+        //compiles and links a vertex and a fragment shader, defines are inserted after the #version line of both,
+        //with a cache directory set the linked binary is loaded from and stored there (glGetProgramBinary),
+        //keyed by the sources, the defines, the attributes and the driver vendor, renderer and version,
+        //invalid or rejected cache files fall back to compiling
+        //attributes are bound to the generic locations 0, 1, ... in order before linking
+        //(compatibility profiles only issue vertices when generic attribute 0 is enabled)
+        //runtime_error if doesnt compile or link
+        static Program build(const char *vertex_src, const char *fragment_src, const std::string &defines = "", const std::vector<std::string> &attributes = {});
+
+        //program binary cache of build, "" (default) disables it
+        //created on first store if missing, set it before building programs on other threads
+        static void set_cache_directory(const std::string &directory);
+        static std::string cache_directory();
+        //GL 4.1 or ARB_get_program_binary with at least one binary format
+        static bool binary_cache_supported() noexcept;
+
         //logic_error if already created 
         void create();
 
@@ -37,6 +55,8 @@ namespace GlUtil{
         void delete_program() noexcept;
     private:
         static Program link_new(const Shader *shader, ...);
+        static bool load_binary(const std::string &path, std::uint64_t key, Program &result);
+        static void store_binary(const std::string &directory, const std::string &path, std::uint64_t key, const Program &program);
         GLuint _id;
     };
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Shader.hpp"
+#include "../Profiler.hpp"
 
 namespace GlUtil{
 
@@ -11,6 +12,8 @@ Shader::Shader(GLuint id) noexcept{
 }
 
 Shader Shader::compile_new(GLenum type, const char *src){
+    //the status query waits for the compiler, so the timer covers the whole compilation
+    Profiler::ScopedTimer timer(Profiler::CPU_SHADER_COMPILE);
     Shader result;
     result.create(type);
     result.source(src);
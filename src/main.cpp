@@ -1,6 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <array>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
 
 #include <GL/glew.h>
 #include <SDL2/SDL.h>
@@ -8,6 +15,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "glutil/Program.hpp"
+#include "glutil/HeadlessContext.hpp"
 #include "Shape.hpp"
 
 enum Texture{
@@ -17,6 +25,15 @@ enum Texture{
     TEXTRES_COUNT,
 };
 
+struct HeadlessOptions{
+    std::size_t frames;
+    int width;
+    int height;
+    //frames saved as <dump_prefix><frame>.ppm
+    std::vector<std::size_t> dump;
+    std::string dump_prefix;
+};
+
 class App{
 public:
     void run(){
@@ -31,6 +48,7 @@ public:
         SDL_GL_MakeCurrent(window, gl_rc);
         if(glewInit() != GLEW_OK) exit(4);
 
+        SDL_GL_GetDrawableSize(window, &viewport_width, &viewport_height);
         on_init();
 
         SDL_Event ev;
@@ -46,7 +64,115 @@ public:
 
         on_destruct();
     }
+
+    //renders frames into a framebuffer of a surfaceless egl context, no display needed,
+    //animation time advances 1/60 s per frame so runs are reproducible
+    //prints cpu (issuing the frame) and gpu (GL_TIME_ELAPSED) frame time statistics
+    void run_headless(const HeadlessOptions &options){
+        std::unique_ptr<GlUtil::HeadlessContext> context;
+        try{
+            context = std::make_unique<GlUtil::HeadlessContext>();
+        }
+        catch(std::exception &e){
+            std::cerr << e.what() << std::endl;
+            exit(5);
+        }
+
+        GLuint color_buffer;
+        glGenRenderbuffers(1, &color_buffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) exit(6);
+
+        glViewport(0, 0, options.width, options.height);
+        viewport_width = options.width;
+        viewport_height = options.height;
+        on_init();
+
+        //an untimed first frame takes shader compilation (jit on llvmpipe) and first use costs out of the statistics
+        on_draw(0.0f);
+        glFinish();
+
+        //queries are read after the last frame, so timing never waits for the gpu
+        bool gpu_timing = GLEW_ARB_timer_query;
+        std::vector<GLuint> queries(gpu_timing ? options.frames : 0);
+        if(gpu_timing) glGenQueries(queries.size(), queries.data());
+
+        std::vector<double> cpu_ms;
+        std::vector<std::uint8_t> pixels;
+        for(std::size_t frame = 0; frame < options.frames; frame++){
+            auto begin = std::chrono::steady_clock::now();
+            if(gpu_timing) glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+
+            on_draw(frame / 60.0f);
+
+            if(gpu_timing) glEndQuery(GL_TIME_ELAPSED);
+            cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+
+            if(std::find(options.dump.begin(), options.dump.end(), frame) != options.dump.end()){
+                pixels.resize((std::size_t)options.width * options.height * 4);
+                glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+                std::string file = options.dump_prefix + std::to_string(frame) + ".ppm";
+                if(!write_ppm(file, options.width, options.height, pixels)){
+                    std::cerr << "can not write " << file << std::endl;
+                }
+            }
+        }
+        glFinish();
+
+        std::vector<double> gpu_ms;
+        for(GLuint query:queries){
+            GLuint64 ns;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+            gpu_ms.push_back(ns * 1e-6);
+        }
+
+        std::cout << options.frames << " frames at " << options.width << "x" << options.height << std::endl;
+        print_statistics("cpu", cpu_ms);
+        if(gpu_timing) print_statistics("gpu", gpu_ms);
+        else std::cout << "gpu: no GL_ARB_timer_query" << std::endl;
+
+        if(gpu_timing) glDeleteQueries(queries.size(), queries.data());
+        on_destruct();
+        renderer.uninit();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &color_buffer);
+    }
 private:
+    //binary ppm, rgba rows bottom up as glReadPixels returns them
+    static bool write_ppm(const std::string &file, int width, int height, const std::vector<std::uint8_t> &rgba){
+        std::ofstream out(file, std::ios::binary);
+        out << "P6\n" << width << " " << height << "\n255\n";
+
+        std::vector<char> row(width * 3);
+        for(int y = height - 1; y >= 0; y--){
+            for(int x = 0; x < width; x++){
+                memcpy(&row[x * 3], &rgba[((std::size_t)y * width + x) * 4], 3);
+            }
+            out.write(row.data(), row.size());
+        }
+        return (bool)out;
+    }
+
+    //min, median and 99th percentile (nearest rank)
+    static void print_statistics(const char *name, std::vector<double> ms){
+        if(ms.empty()) return;
+
+        std::sort(ms.begin(), ms.end());
+        std::size_t p99 = (ms.size() * 99 + 99) / 100 - 1;
+        std::cout << name << " ms: min " << ms.front()
+            << " median " << ms[ms.size() / 2]
+            << " p99 " << ms[p99] << std::endl;
+    }
+
     void on_init(){
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -98,15 +224,21 @@ private:
         switch (ev.event){
         case SDL_WINDOWEVENT_RESIZED:
             glViewport(0, 0, ev.data1, ev.data2);
+            viewport_width = ev.data1;
+            viewport_height = ev.data2;
             break;
         }
     }
 
     void on_render(){
+        on_draw(SDL_GetTicks() * 0.001);
+        SDL_GL_SwapWindow(window);
+    }
+
+    void on_draw(float time){
         glClearColor(0.0, 0.0, 0.0, 1.0);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        float time = SDL_GetTicks() * 0.001;
         float progress = sinf(time) * 0.5 + 0.5;
 
         glm::mat4 mvp = glm::identity<glm::mat4>();
@@ -115,20 +247,97 @@ private:
         mvp = glm::rotate(mvp, time, rotation);
 
         glm::vec4 color(0.2, 0.4, 0.8, 1);
+        renderer.begin_frame(viewport_width, viewport_height);
         renderer.render_morph(textures[TEXTURE_SHAPE], textures[TEXTURE_SHAPE2], color, 2, progress, mvp);
-
-        SDL_GL_SwapWindow(window);
+        renderer.end_frame();
     }
 
     Shape::Renderer renderer;
     std::array<GLuint, Texture::TEXTRES_COUNT> textures;
     bool alive;
-    SDL_Window *window;
+    //nullptr in headless runs
+    SDL_Window *window = nullptr;
+    int viewport_width;
+    int viewport_height;
 };
 
-int main(void){
+static void usage(const char *name){
+    std::cerr << "usage: " << name << " [--headless [--frames N] [--size WxH] [--dump FRAME,...] [--dump-prefix PATH]] [--shader-cache DIR]" << std::endl;
+}
+
+//parses a whole unsigned number, false on anything else
+static bool parse_count(const char *text, std::size_t &count){
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if(end == text || *end != '\0' || text[0] == '-') return false;
+
+    count = value;
+    return true;
+}
+
+int main(int argc, char **argv){
     App app;
 
-    app.run();
+    bool headless = false;
+    HeadlessOptions options{600, 800, 600, {}, "frame"};
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = true;
+
+        if(arg == "--headless"){
+            headless = true;
+        }
+        else if(arg == "--frames" && value){
+            ok = parse_count(value, options.frames);
+            i++;
+        }
+        else if(arg == "--size" && value){
+            const char *x = strchr(value, 'x');
+            std::size_t width, height;
+            ok = x && parse_count(std::string(value, x).c_str(), width) && parse_count(x + 1, height)
+                && width > 0 && height > 0 && width <= 16384 && height <= 16384;
+            if(ok){
+                options.width = width;
+                options.height = height;
+            }
+            i++;
+        }
+        else if(arg == "--dump" && value){
+            std::string list = value;
+            std::size_t begin = 0;
+            while(ok && begin <= list.size()){
+                std::size_t end = std::min(list.find(',', begin), list.size());
+                std::size_t frame;
+                ok = parse_count(list.substr(begin, end - begin).c_str(), frame);
+                options.dump.push_back(frame);
+                begin = end + 1;
+            }
+            i++;
+        }
+        else if(arg == "--dump-prefix" && value){
+            options.dump_prefix = value;
+            i++;
+        }
+        else if(arg == "--shader-cache" && value){
+            GlUtil::Program::set_cache_directory(value);
+            i++;
+        }
+        else{
+            ok = false;
+        }
+
+        if(!ok){
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(headless){
+        app.run_headless(options);
+    }
+    else{
+        app.run();
+    }
     return 0;
 }
@@ -0,0 +1,139 @@
+//Shape::Renderer::bake_circles read back with read_shape against Shape::draw_circles,
+//in a surfaceless egl context (Mesa llvmpipe on machines without a gpu), built and run by `make test`
+//
+//glsl sqrt and division are not correctly rounded, so GL_R32F bakes must be within a few float ulp of the cpu field
+//(relative to the values the circle distances are computed from), GL_R16F bakes within one half float ulp more,
+//infinities (fragments no circle reaches) must match exactly
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+
+#include "../glutil/HeadlessContext.hpp"
+#include "../Shape.hpp"
+
+namespace{
+
+std::vector<Shape::Circle> test_circles(std::size_t count, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> pos(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> radius(-0.05f, 0.4f);
+
+    std::vector<Shape::Circle> circles;
+    for(std::size_t i = 0; i < count; i++){
+        circles.push_back(Shape::Circle{glm::vec2(pos(random), pos(random)), radius(random)});
+    }
+    if(count){
+        circles.push_back(Shape::Circle{glm::vec2(0.0f, 0.0f), -0.0f});
+    }
+    return circles;
+}
+
+//absolute error of a few float ulp of the operands, distances in gl space are at most about 3
+float float_tolerance(float expected){
+    return 1e-6f * std::max(4.0f, fabsf(expected));
+}
+
+bool within_float(float expected, float actual){
+    if(std::isinf(expected)) return actual == expected;
+    return fabsf(actual - expected) <= float_tolerance(expected);
+}
+
+//one half float ulp of a value within float tolerance of the expected one
+bool within_half(float expected, float actual){
+    if(std::isinf(expected)) return actual == expected;
+
+    int exponent;
+    frexpf(expected, &exponent);
+    float ulp = std::max(ldexpf(1.0f, exponent - 11), ldexpf(1.0f, -24));
+    return fabsf(actual - expected) <= ulp + float_tolerance(expected);
+}
+
+bool check(Shape::Renderer &renderer, GLuint texture, std::size_t width, std::size_t height,
+const std::vector<Shape::Circle> &circles, ShapeFormat::Format format){
+    Shape expected(width, height);
+    expected.draw_circles(circles);
+
+    renderer.bake_circles(circles, width, height, texture, format);
+    Shape actual = renderer.read_shape(texture);
+    if(actual.get_width() != width || actual.get_height() != height || glGetError() != GL_NO_ERROR){
+        return false;
+    }
+
+    const float *e = static_cast<const float*>(expected.view().fragments);
+    const float *a = static_cast<const float*>(actual.view().fragments);
+    bool (*within)(float, float) = format == ShapeFormat::FORMAT_FLOAT32 ? within_float : within_half;
+    for(std::size_t i = 0; i < width * height; i++){
+        if(!within(e[i], a[i])) return false;
+    }
+    return true;
+}
+
+}
+
+int main(){
+    std::unique_ptr<GlUtil::HeadlessContext> context;
+    try{
+        context = std::make_unique<GlUtil::HeadlessContext>();
+    }
+    catch(std::exception &e){
+        std::cerr << "bake_circles: no headless gl context: " << e.what() << std::endl;
+        return 1;
+    }
+
+    Shape::Renderer renderer;
+    renderer.init();
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+
+    const std::size_t sizes[][2] = {{1, 1}, {37, 29}, {128, 128}, {370, 260}};
+    const std::size_t counts[] = {0, 1, 129, 1000};
+    const ShapeFormat::Format formats[] = {ShapeFormat::FORMAT_FLOAT32, ShapeFormat::FORMAT_FLOAT16};
+
+    std::size_t failures = 0;
+    std::size_t checks = 0;
+    for(const auto &size:sizes){
+        for(std::size_t count:counts){
+            std::vector<Shape::Circle> circles = test_circles(count, (unsigned)(size[0] * 31 + size[1] + count));
+
+            for(ShapeFormat::Format format:formats){
+                checks++;
+                if(!check(renderer, texture, size[0], size[1], circles, format)){
+                    failures++;
+                    std::cerr << "bake_circles differs from draw_circles: " << size[0] << "x" << size[1]
+                        << ", " << circles.size() << " circles, " << (format == ShapeFormat::FORMAT_FLOAT32 ? "GL_R32F" : "GL_R16F") << std::endl;
+                }
+            }
+        }
+    }
+
+    //a scissor box and masked red must not limit the bake, and must be set again afterwards
+    {
+        std::vector<Shape::Circle> circles = test_circles(129, 1);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, 0, 1, 1);
+        glColorMask(GL_FALSE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        checks++;
+        bool baked = check(renderer, texture, 128, 128, circles, ShapeFormat::FORMAT_FLOAT32);
+        GLboolean color_mask[4];
+        glGetBooleanv(GL_COLOR_WRITEMASK, color_mask);
+        if(!baked || !glIsEnabled(GL_SCISSOR_TEST) || color_mask[0] || !color_mask[1]){
+            failures++;
+            std::cerr << "bake_circles with a scissor box and masked red differs or does not restore them" << std::endl;
+        }
+
+        glDisable(GL_SCISSOR_TEST);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    glDeleteTextures(1, &texture);
+    renderer.uninit();
+
+    std::cout << "bake_circles (" << glGetString(GL_RENDERER) << "): " << checks - failures << "/" << checks << " passed" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+//draw_circles against the same circles drawn one by one with draw_circle, fragment for fragment,
+//built and run by `make test` once per kernel instruction set (SHAPEPP_ISA)
+//
+//covers sizes that are not multiples of the tile size, more circles than one binning pass,
+//zero radii of either sign, circles partly or entirely outside the field, and pools of 1 and several threads
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstring>
+
+#include "../Shape.hpp"
+#include "../ShapeKernel.hpp"
+#include "../ThreadPool.hpp"
+
+namespace{
+
+std::vector<Shape::Circle> test_circles(std::size_t count, unsigned seed){
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> pos(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> radius(-0.05f, 0.4f);
+
+    std::vector<Shape::Circle> circles;
+    for(std::size_t i = 0; i < count; i++){
+        circles.push_back(Shape::Circle{glm::vec2(pos(random), pos(random)), radius(random)});
+    }
+
+    //zero radii of both signs, on a fragment and between fragments
+    circles.push_back(Shape::Circle{glm::vec2(0.0f, 0.0f), 0.0f});
+    circles.push_back(Shape::Circle{glm::vec2(0.0f, 0.0f), -0.0f});
+    circles.push_back(Shape::Circle{glm::vec2(0.013f, -0.27f), -0.0f});
+    circles.push_back(Shape::Circle{glm::vec2(-1.0f, -1.0f), 0.0f});
+    //covering the whole field
+    circles.push_back(Shape::Circle{glm::vec2(0.2f, 0.1f), 3.0f});
+    return circles;
+}
+
+//a Shape with its fragments readable
+class Field: public Shape{
+public:
+    using Shape::Shape;
+
+    const std::vector<float> &get_fragments() const noexcept{
+        return fragments;
+    }
+};
+
+bool same_fragments(const Field &expected, const Field &actual){
+    return memcmp(expected.get_fragments().data(), actual.get_fragments().data(), expected.get_fragments().size() * sizeof(float)) == 0;
+}
+
+bool check(std::size_t width, std::size_t height, const std::vector<Shape::Circle> &circles, ThreadPool *pool){
+    Field expected(width, height);
+    for(const auto &circle:circles){
+        expected.draw_circle(circle.pos, circle.radius);
+    }
+
+    Field actual(width, height);
+    actual.set_thread_pool(pool);
+    actual.draw_circles(circles);
+    if(!same_fragments(expected, actual)){
+        return false;
+    }
+
+    //again on a field that is already drawn, where floors cull most tiles
+    for(const auto &circle:circles){
+        expected.draw_circle(-circle.pos, circle.radius * 0.5f);
+    }
+    std::vector<Shape::Circle> mirrored;
+    for(const auto &circle:circles){
+        mirrored.push_back(Shape::Circle{-circle.pos, circle.radius * 0.5f});
+    }
+    actual.draw_circles(mirrored);
+    return same_fragments(expected, actual);
+}
+
+}
+
+int main(){
+    const std::size_t sizes[][2] = {{1, 1}, {1, 37}, {31, 1}, {33, 31}, {97, 65}, {256, 256}, {301, 257}};
+    const std::size_t counts[] = {0, 1, 7, 600};
+
+    ThreadPool single(1);
+    ThreadPool several(4);
+    ThreadPool *pools[] = {nullptr, &single, &several};
+
+    std::size_t failures = 0;
+    std::size_t checks = 0;
+    for(const auto &size:sizes){
+        for(std::size_t count:counts){
+            std::vector<Shape::Circle> circles = test_circles(count, (unsigned)(size[0] * 31 + size[1] + count));
+
+            for(ThreadPool *pool:pools){
+                checks++;
+                if(!check(size[0], size[1], circles, pool)){
+                    failures++;
+                    std::cerr << "draw_circles differs from draw_circle: " << size[0] << "x" << size[1]
+                        << ", " << circles.size() << " circles, pool of " << (pool ? pool->size() : 0) << std::endl;
+                }
+            }
+        }
+    }
+
+    std::cout << "draw_circles (" << ShapeKernel::isa() << "): " << checks - failures << "/" << checks << " passed" << std::endl;
+    return failures ? 1 : 0;
+}